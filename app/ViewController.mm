@@ -101,7 +101,9 @@
 	if( indexPath.row >= 0 && indexPath.row < reader.total() )
 	{
 		auto&& line = reader[ indexPath.row ];
-		[cell.textLabel setText: [NSString stringWithUTF8String: line.from]];
+		// not every log is UTF-8, nor every line cut in time
+		NSString* text = [NSString stringWithUTF8String: line.from];
+		[cell.textLabel setText: text ? text : [NSString stringWithCString: line.from encoding: NSISOLatin1StringEncoding]];
 	}
 
 	return cell;
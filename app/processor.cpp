@@ -3,7 +3,10 @@
 #include <lib/basic.h>
 #include <lib/logreader.h>
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <unistd.h>
 
 const char RESULT[] = "results.log";
 const char INDEX[] = "results.idx";
@@ -17,7 +20,7 @@ Processor::Processor( const char* input, const char* filter, const char* outdir
 	finput = fopen( input, "r" );
 
 	reader = new CLogReader(writer);
-	if( !reader->SetFilter(filter) )
+	if( !reader->SetFilter( filter, Filter::UTF8 ) ) // as typed, a '?' stands for a character
 	{
 		delete reader;
 	}
@@ -71,9 +74,8 @@ time_t Processor::Process()
 		}
 	}
 
-	writer->Flush();
-
 	delete[] buf;
+	writer->Wait();
 
 	time( &finished );
 	return finished - started;
@@ -90,6 +92,31 @@ void Processor::Cleanup()
 	delete writer;
 }
 
+// writes the whole of the data at the offset
+static bool WriteAt( int fd, const void* data, size_t size, size_t offset )
+{
+	auto p = static_cast< const char* >(data);
+	while(size)
+	{
+		const auto written = pwrite( fd, p, size, offset );
+		if( written < 0 && errno == EINTR )
+		{
+			continue;
+		}
+
+		if( written <= 0 )
+		{
+			return false;
+		}
+
+		p += written;
+		size -= written;
+		offset += written;
+	}
+
+	return true;
+}
+
 Processor::Writer::Writer( const char* dir )
 {
 	assert(dir);
@@ -102,61 +129,153 @@ Processor::Writer::Writer( const char* dir )
 	assert( res == sz );
 
 	remove(path);
-	if( (fresult = fopen( path, "w" )) )
+	if( (fresult = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 )) >= 0 )
 	{
 		[[maybe_unused]] auto res = snprintf( path, sz+1, "%s/%s", dir, INDEX );
 		assert( res == sz );
 
 		remove(path);
-		if( (findex = fopen( path, "wb" )) )
+		if( (findex = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 )) >= 0 )
 		{
-			StoreOffset();
+			// the index starts with the offset of the first line
+			[[maybe_unused]] auto res = WriteAt( findex, &offset, sizeof(offset), 0 );
+			assert(res);
 		}
 	}
 
 	delete[] path;
+
+	pthread_mutex_init( &mutex, nullptr );
+	pthread_cond_init( &changed, nullptr );
+
+	started = !pthread_create( &thread, nullptr, Work, this );
 }
 
 Processor::Writer::~Writer()
 {
-	if(findex)
+	if(started)
+	{
+		Flush();
+
+		pthread_mutex_lock(&mutex);
+		stop = true;
+		pthread_cond_broadcast(&changed);
+		pthread_mutex_unlock(&mutex);
+
+		pthread_join( thread, nullptr );
+	}
+
+	pthread_cond_destroy(&changed);
+	pthread_mutex_destroy(&mutex);
+
+	if( findex >= 0 )
 	{
-		fclose(findex);
+		close(findex);
 	}
 
-	if(fresult)
+	if( fresult >= 0 )
 	{
-		fclose(fresult);
+		close(fresult);
 	}
 }
 
-void Processor::Writer::Handle( const Sequence<Line>& lines )
+void Processor::Writer::Handle( const Sequence<Line>& seq )
 {
-	for( const auto& line : lines )
+	auto& batch = *filling;
+	if( batch.ends.empty() )
 	{
-		fwrite( line.from, 1, line.length(), fresult );
-		fputc( '\n', fresult );
+		batch.offset = offset;
+		batch.number = count;
+	}
+
+	for( const auto& line : seq )
+	{
+		batch.text.Append(line);
+		batch.text.Append('\n');
 
 		offset += line.length() + 1;
-		StoreOffset();
+		batch.ends.Append(offset);
 	}
+
+	count += seq.length();
 }
 
-void Processor::Writer::StoreOffset()
+void Processor::Writer::Flush()
 {
-	[[maybe_unused]] auto res = fwrite( &offset, sizeof(offset), 1, findex );
-	assert( res == 1 );
+	if( filling->ends.empty() )
+	{
+		return;
+	}
+
+	// the previous block is written by now unless the matching of this one took less
+	pthread_mutex_lock(&mutex);
+	while(pending)
+	{
+		pthread_cond_wait( &changed, &mutex );
+	}
+
+	pending = filling;
+	pthread_cond_broadcast(&changed);
+	pthread_mutex_unlock(&mutex);
+
+	filling = filling == batches ? batches + 1 : batches;
+	filling->text.Clear();
+	filling->ends.Clear();
 }
 
-void Processor::Writer::Flush()
+void Processor::Writer::Wait()
 {
-	if(fresult)
+	Flush();
+
+	pthread_mutex_lock(&mutex);
+	while(pending)
 	{
-		fflush(fresult);
+		pthread_cond_wait( &changed, &mutex );
 	}
 
-	if(findex)
+	pthread_mutex_unlock(&mutex);
+}
+
+void* Processor::Writer::Work( void* param )
+{
+	reinterpret_cast< Writer* >(param)->Work();
+	return nullptr;
+}
+
+void Processor::Writer::Work()
+{
+	pthread_mutex_lock(&mutex);
+
+	for( ;; )
 	{
-		fflush(findex);
+		while( !pending && !stop )
+		{
+			pthread_cond_wait( &changed, &mutex );
+		}
+
+		if( !pending )
+		{
+			break;
+		}
+
+		const auto batch = pending;
+		pthread_mutex_unlock(&mutex);
+
+		Write(*batch);
+
+		pthread_mutex_lock(&mutex);
+		pending = nullptr;
+		pthread_cond_broadcast(&changed);
 	}
+
+	pthread_mutex_unlock(&mutex);
+}
+
+void Processor::Writer::Write( const Batch& batch ) const
+{
+	// the index holds the offset of the end of every line following the offset of the beginning of the first one
+	[[maybe_unused]] auto res = WriteAt( fresult, batch.text.data().from, batch.text.size(), batch.offset ) &&
+		WriteAt( findex, batch.ends.data().from, batch.ends.size() * sizeof(size_t), (batch.number + 1) * sizeof(size_t) );
+
+	assert(res);
 }
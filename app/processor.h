@@ -4,6 +4,7 @@
 #include <lib/basic.h>
 #include <lib/logreader.h>
 
+#include <pthread.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <time.h>
@@ -29,21 +30,50 @@ public:
 	bool ready() const;
 
 private:
+	// gathers the matching lines of every block and hands them over at its end to a writer thread started once,
+	// which appends them to the results and the index while the reader matches the next block;
+	// the lines are copied as they are handled, the block is reused by then
 	struct Writer : public CLogReader::Handler
 	{
 		Writer( const char* dir );
-		~Writer();
+		~Writer(); // writes the rest and stops the thread
 
 		void Handle( const Sequence<Line>& ) override;
+		void Flush() override;
 
-		void StoreOffset();
-		void Flush();
+		void Wait(); // until the lines handed over are written
 
-		bool ready() const { return fresult && findex; }
+		bool ready() const { return fresult >= 0 && findex >= 0 && started; }
 
-		FILE *fresult = nullptr, *findex = nullptr;
+		// the lines of a block with their line breaks and their index entries
+		struct Batch
+		{
+			Buffer<char> text;
+			Buffer<size_t> ends; // the offsets of the ends of the lines
 
-		size_t offset = 0;
+			size_t offset; // in the results
+			size_t number; // of the first line in the results
+		};
+
+		static void* Work( void* param ); // thread func
+		void Work();
+
+		void Write( const Batch& ) const;
+
+		int fresult = -1, findex = -1;
+
+		size_t offset = 0; // of the end of the results, with the lines handled
+		size_t count = 0; // lines handled
+
+		Batch batches[2];
+		Batch* filling = batches; // by the handler
+		Batch* pending = nullptr; // handed over, until written
+
+		pthread_t thread;
+		pthread_mutex_t mutex;
+		pthread_cond_t changed;
+		bool started = false;
+		bool stop = false;
 	};
 
 	void Cleanup();
@@ -0,0 +1,191 @@
+#ifndef __CORPUS_HEADER__
+#define __CORPUS_HEADER__
+
+#include "basic.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// deterministic pseudo-random generator (xorshift64*)
+struct Random
+{
+	Random( uint64_t seed ) : state( seed ? seed : 1 ) {}
+
+	uint64_t Next()
+	{
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+
+		return state * 0x2545F4914F6CDD1DULL;
+	}
+
+	size_t Below( size_t n ) { return Next() % n; }
+	double Uniform() { return (Next() >> 11) * (1.0 / 9007199254740992.0); }
+
+	uint64_t state;
+};
+
+// parameters of a synthetic log
+struct Profile
+{
+	enum Lengths
+	{
+		FIXED, // every line is about 'length' long
+		UNIFORM, // from length/2 to 3*length/2
+		LOGNORMAL, // a heavy tail of long lines around 'length'
+		BIMODAL, // 90% of short lines and 10% of lines 10 times longer
+	};
+
+	Lengths lengths = UNIFORM;
+	size_t length = 100; // mean line length
+
+	double density = 0.01; // fraction of the lines containing the NEEDLE
+
+	uint64_t seed = 1;
+
+	static constexpr const char* NEEDLE = "ERROR";
+
+	static bool Parse( const char* name, Lengths& );
+	static const char* Name( Lengths );
+};
+
+inline bool Profile::Parse( const char* name, Lengths& lengths )
+{
+	for( int i = FIXED; i <= BIMODAL; ++i )
+	{
+		if( !strcmp( name, Name( Lengths(i) ) ) )
+		{
+			lengths = Lengths(i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+inline const char* Profile::Name( Lengths lengths )
+{
+	switch(lengths)
+	{
+	case FIXED: return "fixed";
+	case UNIFORM: return "uniform";
+	case LOGNORMAL: return "lognormal";
+	case BIMODAL: return "bimodal";
+	}
+
+	return "";
+}
+
+// generates a deterministic stream of log lines following the profile
+class Generator
+{
+public:
+	Generator( const Profile& prfl ) : profile(prfl), rnd( prfl.seed ) {}
+
+	// appends complete lines to the buffer until it holds at least 'size' bytes
+	void Fill( Buffer<char>&, size_t size );
+
+	size_t lines = 0; // generated so far
+	size_t matches = 0; // lines with the needle
+
+private:
+	size_t Length();
+
+	const Profile profile;
+	Random rnd;
+};
+
+inline void Generator::Fill( Buffer<char>& buffer, size_t size )
+{
+	static const char* const LEVELS[] = { "INFO", "DEBUG", "WARN", "TRACE" };
+	static const char* const WORDS[] = { "GET", "POST", "user", "login", "failed", "for", "timeout", "request",
+		"id=4217", "ok", "db", "api", "session", "cache", "miss", "latency=12ms", "status=200", "/v1/items" };
+
+	constexpr size_t NLEVELS = sizeof(LEVELS) / sizeof(*LEVELS);
+	constexpr size_t NWORDS = sizeof(WORDS) / sizeof(*WORDS);
+
+	buffer.Reserve(size);
+
+	char head[64];
+	while( buffer.size() < size )
+	{
+		const size_t start = buffer.size();
+		const size_t length = Length();
+
+		const bool match = rnd.Uniform() < profile.density;
+
+		auto n = snprintf( head, sizeof(head), "2024-01-%02d %02d:%02d:%02d.%03d %s", int( rnd.Below(28) + 1 ), int( rnd.Below(24) ),
+			int( rnd.Below(60) ), int( rnd.Below(60) ), int( rnd.Below(1000) ), LEVELS[ rnd.Below(NLEVELS) ] );
+		buffer.Append( {head, head+n} );
+
+		// put the needle at a random word position
+		const size_t at = match ? start + n + rnd.Below( length > size_t(n) ? length - n : 1 ) : SIZE_MAX;
+		bool placed = false;
+
+		while( buffer.size() - start < length || (match && !placed) )
+		{
+			const char* word = !placed && buffer.size() >= at ? Profile::NEEDLE : WORDS[ rnd.Below(NWORDS) ];
+			placed = placed || word == Profile::NEEDLE;
+
+			buffer.Append(' ');
+			buffer.Append( {word, word + strlen(word)} );
+		}
+
+		buffer.Append('\n');
+
+		++lines;
+		matches += match;
+	}
+}
+
+inline size_t Generator::Length()
+{
+	const double mean = profile.length;
+
+	switch( profile.lengths )
+	{
+	case Profile::FIXED:
+		return profile.length;
+
+	case Profile::UNIFORM:
+		return size_t( mean / 2 + rnd.Uniform() * mean );
+
+	case Profile::LOGNORMAL:
+	{
+		// sigma = 1, scaled to keep the mean
+		const double u1 = rnd.Uniform() + 1e-12, u2 = rnd.Uniform();
+		const double normal = sqrt( -2 * log(u1) ) * cos( 2 * M_PI * u2 );
+
+		return size_t( mean * exp( normal - 0.5 ) );
+	}
+
+	case Profile::BIMODAL:
+		return rnd.Below(10) ? profile.length * 10 / 19 : profile.length * 100 / 19;
+	}
+
+	return profile.length;
+}
+
+// monotonic time in seconds
+inline double Now()
+{
+	timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// processor time of the process in seconds
+inline double Cpu()
+{
+	timespec ts;
+	clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &ts );
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#endif // !__CORPUS_HEADER__
@@ -0,0 +1,141 @@
+// compares the virtual handler dispatch of CLogReader with the compile-time bound BasicLogReader
+// on a counting and an aggregating workload
+
+#include "corpus.h"
+
+#include "basiclogreader.h"
+#include "logreader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct Counter
+{
+	void Handle( const Sequence<char>& ) { ++total; }
+	void Merge( Counter& other ) { total += other.total; other.total = 0; }
+
+	size_t count() const { return total; }
+
+	size_t total = 0;
+};
+
+// a histogram of the matching line lengths
+struct Histogram
+{
+	static constexpr size_t BUCKETS = 256;
+
+	void Handle( const Sequence<char>& line )
+	{
+		++buckets[ line.length() < BUCKETS ? line.length() : BUCKETS-1 ];
+		bytes += line.length();
+	}
+
+	void Merge( Histogram& other )
+	{
+		for( size_t i = 0; i < BUCKETS; ++i )
+		{
+			buckets[i] += other.buckets[i];
+			other.buckets[i] = 0;
+		}
+
+		bytes += other.bytes;
+		other.bytes = 0;
+	}
+
+	size_t count() const
+	{
+		size_t total = 0;
+		for( auto n : buckets ) total += n;
+
+		return total;
+	}
+
+	size_t buckets[BUCKETS] = {};
+	size_t bytes = 0;
+};
+
+// adapts a compile-time handler to the polymorphic interface
+template< typename T >
+struct Virtual : CLogReader::Handler
+{
+	void Handle( const Sequence<Line>& lines ) override
+	{
+		for( const auto& line : lines )
+		{
+			impl.Handle(line);
+		}
+	}
+
+	T impl;
+};
+
+constexpr size_t CHUNK = 10*1024*1024;
+
+template< typename Reader >
+double Feed( Reader& reader, const Sequence<char>& text )
+{
+	const auto started = Now();
+	for( auto p = text.from; p < text.to; p += CHUNK )
+	{
+		reader.AddSourceBlock( p, p + CHUNK < text.to ? CHUNK : text.to - p );
+	}
+
+	return Now() - started;
+}
+
+void Report( const char* workload, const char* name, double seconds, size_t bytes, size_t count )
+{
+	printf( "%-10s %-28s %8.3f GB/s %10zu matches\n", workload, name, bytes / seconds / 1e9, count );
+}
+
+template< typename T >
+void RunPolymorphic( const char* workload, const Sequence<char>& text, const char* filter )
+{
+	Virtual<T> handler;
+
+	CLogReader reader( &handler );
+	reader.SetFilter(filter);
+
+	auto seconds = Feed( reader, text );
+	Report( workload, "CLogReader", seconds, text.length(), handler.impl.count() );
+}
+
+template< typename T, typename Matcher >
+void RunBasic( const char* workload, const char* name, const Sequence<char>& text, const char* filter )
+{
+	BasicLogReader< T, Matcher > reader;
+	if( !reader.SetFilter(filter) )
+	{
+		printf( "%-10s %-28s the filter does not fit\n", workload, name );
+		return;
+	}
+
+	auto seconds = Feed( reader, text );
+	Report( workload, name, seconds, text.length(), reader.handler().count() );
+}
+
+int main( int argc, const char* argv[] )
+{
+	const size_t size = argc > 1 ? strtoull( argv[1], nullptr, 10 ) << 20 : 256 << 20;
+	const double ratio = argc > 2 ? atof( argv[2] ) : 0.5;
+	const char* filter = "*ERROR*";
+
+	Profile profile;
+	profile.density = ratio;
+
+	Buffer<char> corpus;
+	Generator( profile ).Fill( corpus, size );
+
+	const auto text = corpus.data();
+	printf( "corpus: %zu bytes, match ratio %.3f, filter %s\n", text.length(), ratio, filter );
+
+	RunPolymorphic<Counter>( "count", text, filter );
+	RunBasic< Counter, WildcardMatcher >( "count", "BasicLogReader<Wildcard>", text, filter );
+	RunBasic< Counter, SubstringMatcher >( "count", "BasicLogReader<Substring>", text, filter );
+
+	RunPolymorphic<Histogram>( "aggregate", text, filter );
+	RunBasic< Histogram, WildcardMatcher >( "aggregate", "BasicLogReader<Wildcard>", text, filter );
+	RunBasic< Histogram, SubstringMatcher >( "aggregate", "BasicLogReader<Substring>", text, filter );
+
+	return 0;
+}
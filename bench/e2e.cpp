@@ -0,0 +1,246 @@
+// end-to-end throughput of 'logreader -c' compared to 'grep -c' on a matrix of synthetic corpora
+// usage: bench_e2e --logreader <path> [--grep <command>] [--sizes <MB,...>] [--runs <n>] [--dir <path>] [--json <path>]
+
+#include "corpus.h"
+#include "report.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct Options
+{
+	const char* logreader = nullptr;
+	const char* grep = "LC_ALL=C grep";
+	const char* dir = "/tmp";
+	const char* json = nullptr;
+
+	Buffer<size_t> sizes; // MB
+	size_t runs = 3;
+};
+
+// writes at least 'size' bytes of the corpus to the file, returns false on failure
+static bool Write( const char* path, size_t size, Generator& generator, size_t& written )
+{
+	FILE* file = fopen( path, "w" );
+	if( !file )
+	{
+		return false;
+	}
+
+	constexpr size_t CHUNK = 16 << 20;
+
+	Buffer<char> chunk;
+	bool ok = true;
+
+	for( written = 0; ok && written < size; )
+	{
+		chunk.Clear();
+		generator.Fill( chunk, size - written < CHUNK ? size - written : CHUNK );
+
+		ok = fwrite( &chunk.front(), 1, chunk.size(), file ) == chunk.size();
+		written += chunk.size();
+	}
+
+	return fclose(file) == 0 && ok;
+}
+
+// runs the command and parses the count it prints, returns the best time of the runs
+static double Time( const char* command, size_t runs, size_t& count )
+{
+	double best = 1e30;
+
+	// the first run warms up the page cache
+	for( size_t i = 0; i <= runs; ++i )
+	{
+		const auto started = Now();
+
+		FILE* pipe = popen( command, "r" );
+		if( !pipe )
+		{
+			return -1;
+		}
+
+		unsigned long long n = 0;
+		const bool parsed = fscanf( pipe, "%llu", &n ) == 1;
+
+		if( pclose(pipe) != 0 || !parsed )
+		{
+			return -1;
+		}
+
+		const auto seconds = Now() - started;
+		if(i)
+		{
+			best = seconds < best ? seconds : best;
+		}
+
+		count = n;
+	}
+
+	return best;
+}
+
+static bool ParseSizes( const char* list, Buffer<size_t>& sizes )
+{
+	sizes.Clear();
+	for( auto p = list; *p; )
+	{
+		char* end;
+		auto n = strtoull( p, &end, 10 );
+		if( end == p || !n || (*end && *end != ',') )
+		{
+			return false;
+		}
+
+		sizes.Append(n);
+		p = *end ? end+1 : end;
+	}
+
+	return !sizes.empty();
+}
+
+int main( int argc, const char* argv[] )
+{
+	static const char USAGE[] =
+		"usage: bench_e2e --logreader <path> [--grep <command>] [--sizes <MB,...>] [--runs <n>] [--dir <path>] [--json <path>]\n";
+
+	Options options;
+	for( int i = 1; i < argc; ++i )
+	{
+		const char* option = argv[i];
+		const char* value = i+1 < argc ? argv[i+1] : nullptr;
+
+		if( !value )
+		{
+			printf( "%s", USAGE );
+			return 1;
+		}
+		else if( !strcmp( option, "--logreader" ) )
+		{
+			options.logreader = value;
+		}
+		else if( !strcmp( option, "--grep" ) )
+		{
+			options.grep = value;
+		}
+		else if( !strcmp( option, "--sizes" ) && ParseSizes( value, options.sizes ) )
+		{
+		}
+		else if( !strcmp( option, "--runs" ) && (options.runs = strtoull( value, nullptr, 10 )) )
+		{
+		}
+		else if( !strcmp( option, "--dir" ) )
+		{
+			options.dir = value;
+		}
+		else if( !strcmp( option, "--json" ) )
+		{
+			options.json = value;
+		}
+		else
+		{
+			printf( "invalid option: %s\n%s", option, USAGE );
+			return 1;
+		}
+
+		++i;
+	}
+
+	if( !options.logreader )
+	{
+		printf( "%s", USAGE );
+		return 1;
+	}
+
+	if( options.sizes.empty() )
+	{
+		options.sizes.Append(16);
+		options.sizes.Append(256);
+	}
+
+	Report report( "e2e", options.json );
+	if( !report.ok() )
+	{
+		printf( "cannot write %s\n", options.json );
+		return 1;
+	}
+
+	static const Profile::Lengths LENGTHS[] = { Profile::FIXED, Profile::UNIFORM, Profile::LOGNORMAL, Profile::BIMODAL };
+	static const double DENSITIES[] = { 0.001, 0.1 };
+
+	char path[4096];
+	snprintf( path, sizeof(path), "%s/logreader-bench-%d.log", options.dir, int( getpid() ) );
+
+	char logreader[8192], grep[8192];
+	snprintf( logreader, sizeof(logreader), "'%s' -c '*%s*' '%s'", options.logreader, Profile::NEEDLE, path );
+	snprintf( grep, sizeof(grep), "%s -c -F '%s' '%s'", options.grep, Profile::NEEDLE, path );
+
+	printf( "%-10s %9s %6s %10s %12s %10s %12s %8s\n", "lengths", "density", "MB", "GB/s", "Mlines/s", "grep GB/s", "grep Ml/s", "speedup" );
+
+	bool ok = true;
+	for( size_t s = 0; s < options.sizes.size(); ++s )
+	{
+		for( auto lengths : LENGTHS )
+		{
+			for( auto density : DENSITIES )
+			{
+				Profile profile;
+				profile.lengths = lengths;
+				profile.density = density;
+
+				Generator generator(profile);
+
+				size_t size;
+				if( !Write( path, options.sizes[s] << 20, generator, size ) )
+				{
+					printf( "cannot write %s\n", path );
+					unlink(path);
+					return 1;
+				}
+
+				size_t ours = 0, theirs = 0;
+				const auto seconds = Time( logreader, options.runs, ours );
+				const auto reference = Time( grep, options.runs, theirs );
+
+				unlink(path);
+
+				if( seconds < 0 || reference < 0 )
+				{
+					printf( "cannot run: %s\n", seconds < 0 ? logreader : grep );
+					return 1;
+				}
+
+				// the count must agree with grep and the generator
+				const bool agree = ours == theirs && ours == generator.matches;
+				ok = ok && agree;
+
+				const double gb = size / 1e9, mlines = generator.lines / 1e6;
+				printf( "%-10s %9.3f %6zu %10.3f %12.2f %10.3f %12.2f %7.1fx%s\n", Profile::Name(lengths), density, options.sizes[s],
+					gb / seconds, mlines / seconds, gb / reference, mlines / reference, reference / seconds,
+					agree ? "" : "  COUNT MISMATCH" );
+
+				char name[128];
+				snprintf( name, sizeof(name), "%s/%g/%zuMB", Profile::Name(lengths), density, options.sizes[s] );
+
+				report.Begin(name);
+				report.Field( "lengths", Profile::Name(lengths) );
+				report.Field( "density", density );
+				report.Field( "bytes", double(size) );
+				report.Field( "lines", double( generator.lines ) );
+				report.Field( "matches", double(ours) );
+				report.Field( "seconds", seconds );
+				report.Field( "gbps", gb / seconds );
+				report.Field( "lines_per_second", generator.lines / seconds );
+				report.Field( "grep_seconds", reference );
+				report.Field( "grep_gbps", gb / reference );
+				report.Field( "speedup", reference / seconds );
+				report.Field( "agree", agree ? "yes" : "no" );
+				report.End();
+			}
+		}
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,606 @@
+// differential fuzzing of the matching: CLogReader, its Process and BasicLogReader against a plain wildcard matcher,
+// on random filters, options and inputs fed in blocks split at random
+// usage: bench_fuzz [--runs <n>] [--seed <n>] [<input>...]
+// with the inputs, the cases are decoded from them as from the inputs of libFuzzer, to reproduce its findings;
+// built with LIBFUZZER (see LOGREADER_FUZZ) the cases come from libFuzzer
+
+#include "corpus.h"
+
+#include "basiclogreader.h"
+#include "logreader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// access to the internals of CLogReader
+struct Probe
+{
+	using Results = CLogReader::Results;
+
+	static const char* Process( const Sequence<char>& text, const ExpressionMatcher& matcher, Results& results,
+		Newlines::Scanner* scanner, const LineLimit& limit )
+	{
+		return CLogReader::Process( text, matcher, results, nullptr, scanner, limit );
+	}
+};
+
+struct Case
+{
+	Buffer<char> filter; // zero terminated
+	unsigned options = 0; // Filter flags
+	LineLimit limit;
+
+	Buffer<char> text;
+	Buffer<size_t> blocks; // sizes of the blocks the text is fed in, summing up to its length
+};
+
+// the matching lines as the numbers and the text of every line followed by a line break
+struct Lines
+{
+	void Add( const Sequence<char>& line, size_t number )
+	{
+		numbers.Append(number);
+		text.Append(line);
+		text.Append('\n');
+	}
+
+	bool operator==( const Lines& other ) const
+	{
+		return numbers.size() == other.numbers.size() && text.size() == other.text.size()
+			&& !memcmp( numbers.data().from, other.numbers.data().from, numbers.size() * sizeof(size_t) )
+			&& !memcmp( text.data().from, other.text.data().from, text.size() );
+	}
+
+	Buffer<size_t> numbers;
+	Buffer<char> text;
+};
+
+// the reference: a line matches if the whole of it can be consumed by the filter, '*' taking any characters and '?'
+// one, a character being a byte or, in the UTF-8 mode, a UTF-8 sequence as WildcardMatcher::Next takes it
+class Reference
+{
+public:
+	Reference( const Case& cs ) : filter( cs.filter.data().from ), options(cs.options) {}
+
+	bool Match( const Sequence<char>& line )
+	{
+		const auto m = strlen(filter), n = line.length();
+
+		reached.Resize( (m+1) * (n+1) );
+		memset( &reached[0], 0, reached.size() );
+		reached[0] = true;
+
+		for( size_t i = 0; i < m; ++i )
+		{
+			for( size_t j = 0; j <= n; ++j )
+			{
+				if( !reached[ i * (n+1) + j ] )
+				{
+					continue;
+				}
+
+				if( filter[i] == '*' )
+				{
+					reached[ (i+1) * (n+1) + j ] = true;
+					if( j < n )
+					{
+						reached[ i * (n+1) + Next( line, j ) ] = true;
+					}
+				}
+				else if( j < n && filter[i] == '?' )
+				{
+					reached[ (i+1) * (n+1) + Next( line, j ) ] = true;
+				}
+				else if( j < n && Fold( filter[i] ) == Fold( line.from[j] ) )
+				{
+					reached[ (i+1) * (n+1) + j+1 ] = true;
+				}
+			}
+		}
+
+		return reached[ m * (n+1) + n ];
+	}
+
+	// the matching lines of the text, the unterminated last one included
+	void Run( const Sequence<char>& text, const LineLimit& limit, Lines& lines )
+	{
+		size_t number = 0;
+		for( auto p = text.from; p != text.to; )
+		{
+			auto ln = static_cast< const char* >( memchr( p, '\n', text.to - p ) );
+			ln = ln ? ln : text.to;
+
+			Sequence<char> line = { p, ln }, cut = line;
+			if( limit.Apply(cut) && Match(cut) )
+			{
+				lines.Add( cut, number+1 );
+			}
+
+			++number;
+			p = ln == text.to ? ln : ln+1;
+		}
+	}
+
+private:
+	char Fold( char ch ) const
+	{
+		return options & Filter::ICASE && ch >= 'A' && ch <= 'Z' ? ch - 'A' + 'a' : ch;
+	}
+
+	size_t Next( const Sequence<char>& line, size_t j ) const
+	{
+		const auto lead = static_cast< unsigned char >( line.from[j++] );
+		if( !(options & Filter::UTF8) || lead < 0xC0 )
+		{
+			return j;
+		}
+
+		for( int n = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : 1; n-- && j < line.length() && (line.from[j] & 0xC0) == 0x80; ++j );
+		return j;
+	}
+
+	const char* const filter;
+	const unsigned options;
+
+	Buffer<bool> reached; // the filter prefix by i can consume the line prefix by j
+};
+
+struct Collector : CLogReader::Handler
+{
+	void Handle( const Sequence<Line>& matches ) override
+	{
+		for( const auto& line : matches )
+		{
+			lines.Add( line, line.number );
+		}
+	}
+
+	Lines lines;
+};
+
+// a BasicLogReader handler, the lines are not numbered
+struct Gatherer
+{
+	void Handle( const Sequence<char>& line )
+	{
+		lines.Add( line, 0 );
+	}
+
+	void Merge( Gatherer& other )
+	{
+		lines.numbers.Append( other.lines.numbers.data() );
+		lines.text.Append( other.lines.text.data() );
+
+		other.lines.numbers.Clear();
+		other.lines.text.Clear();
+	}
+
+	Lines lines;
+};
+
+// feeds the text to a reader in the blocks of the case, completing the last line
+template< typename Reader >
+static bool Feed( Reader& reader, const Case& cs )
+{
+	const auto text = cs.text.data();
+
+	auto p = text.from;
+	for( const auto size : cs.blocks.data() )
+	{
+		if( !reader.AddSourceBlock( p, size ) )
+		{
+			return false;
+		}
+
+		p += size;
+	}
+
+	return !text.length() || text.to[-1] == '\n' || reader.AddSourceBlock( "\n", 1 );
+}
+
+static void Dump( FILE* file, const char* label, const Sequence<char>& text )
+{
+	fprintf( file, "%s \"", label );
+	for( auto p = text.from; p != text.to; ++p )
+	{
+		const auto ch = static_cast< unsigned char >(*p);
+		if( ch == '\n' )
+		{
+			fputs( "\\n", file );
+		}
+		else if( ch == '"' || ch == '\\' )
+		{
+			fprintf( file, "\\%c", ch );
+		}
+		else if( ch < 0x20 || ch >= 0x7F )
+		{
+			fprintf( file, "\\x%02x", ch );
+		}
+		else
+		{
+			fputc( ch, file );
+		}
+	}
+
+	fputs( "\"\n", file );
+}
+
+static bool Compare( const Case& cs, const char* reader, const Lines& expected, const Lines& actual )
+{
+	if( expected == actual )
+	{
+		return true;
+	}
+
+	printf( "%s differs from the reference\n", reader );
+	Dump( stdout, "filter", { cs.filter.data().from, cs.filter.data().to - 1 } );
+	printf( "options %u, limit %zu%s, blocks", cs.options, cs.limit.length, cs.limit.policy == LineLimit::SKIP ? " skipped" : "" );
+	for( const auto size : cs.blocks.data() )
+	{
+		printf( " %zu", size );
+	}
+
+	printf( "\n" );
+	Dump( stdout, "text", cs.text.data() );
+	Dump( stdout, "expected", expected.text.data() );
+	Dump( stdout, "actual", actual.text.data() );
+
+	return false;
+}
+
+// returns false on a difference, reported to stdout
+static bool Check( const Case& cs )
+{
+	const auto filter = cs.filter.data().from;
+
+	// a filter is invalid with a line break or, in the UTF-8 mode, with invalid UTF-8
+	const bool valid = !strchr( filter, '\n' ) && (!(cs.options & Filter::UTF8) || Utf8(filter));
+
+	ExpressionMatcher matcher;
+	if( matcher.Set( filter, cs.options ) != valid )
+	{
+		printf( valid ? "the matcher rejects a valid filter\n" : "the matcher takes an invalid filter\n" );
+		Dump( stdout, "filter", { filter, cs.filter.data().to - 1 } );
+		return false;
+	}
+
+	if( !valid )
+	{
+		return true;
+	}
+
+	Lines expected;
+	Reference reference(cs);
+	reference.Run( cs.text.data(), cs.limit, expected );
+
+	// the reader, with the tail carried across the blocks and the blocks split among the workers
+	Collector collector;
+	{
+		CLogReader reader(&collector);
+		if( !reader.SetFilter( filter, cs.options ) )
+		{
+			printf( "the reader rejects a filter the matcher takes\n" );
+			return false;
+		}
+
+		reader.SetLimit(cs.limit);
+		Feed( reader, cs );
+	}
+
+	if( !Compare( cs, "CLogReader", expected, collector.lines ) )
+	{
+		return false;
+	}
+
+	// its matching loop on the whole text, seeking the line breaks byte by byte and in the bitmap
+	Buffer<char> whole;
+	whole.Append( cs.text.data() );
+	if( whole.size() && whole.data().to[-1] != '\n' )
+	{
+		whole.Append('\n');
+	}
+
+	const auto text = whole.data();
+
+	Newlines newlines;
+	for( int seeking = 0; seeking < 2; ++seeking )
+	{
+		newlines.Reset(text);
+		Newlines::Scanner scanner( newlines, text );
+
+		Probe::Results results;
+		const auto rest = Probe::Process( text, matcher, results, seeking ? &scanner : nullptr, cs.limit );
+
+		Lines actual;
+		for( const auto& lines : results )
+		{
+			for( auto line : lines )
+			{
+				cs.limit.Apply(line);
+				actual.Add( line, line.number );
+			}
+		}
+
+		if( !Compare( cs, seeking ? "Process (newlines)" : "Process", expected, actual ) )
+		{
+			return false;
+		}
+
+		if( rest != text.to )
+		{
+			printf( "Process leaves %zu bytes of complete lines\n", size_t( text.to - rest ) );
+			return false;
+		}
+	}
+
+	// the compile-time bound reader, the lines are compared without their numbers
+	BasicLogReader< Gatherer, WildcardMatcher > basic;
+	if( basic.SetFilter( filter, cs.options ) )
+	{
+		basic.SetLimit(cs.limit);
+		Feed( basic, cs );
+
+		expected.numbers.Clear();
+		for( size_t i = 0; i < basic.handler().lines.numbers.size(); ++i )
+		{
+			expected.numbers.Append(0);
+		}
+
+		if( !Compare( cs, "BasicLogReader", expected, basic.handler().lines ) )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// splits the text into blocks of random sizes, mostly small so a line is carried across several of them,
+// some large enough to be split among the workers
+static void Split( Case& cs, Random& random )
+{
+	const auto length = cs.text.size();
+
+	cs.blocks.Clear();
+	for( size_t fed = 0; fed < length; )
+	{
+		const auto kind = random.Below(8);
+		auto size = kind < 4 ? 1 + random.Below(16) : kind < 7 ? 1 + random.Below(4096) : 1 + random.Below( 4 * CLogReader::BLOCK );
+		size = size < length - fed ? size : length - fed;
+
+		cs.blocks.Append(size);
+		fed += size;
+	}
+}
+
+// an input of libFuzzer: a byte of the options, a byte of the limit, a byte of the seed of the split,
+// the filter up to a zero byte and the text
+static bool Decode( const uint8_t* data, size_t size, Case& cs )
+{
+	if( size < 3 )
+	{
+		return false;
+	}
+
+	const auto end = reinterpret_cast< const char* >( data + size );
+	auto p = reinterpret_cast< const char* >( data + 3 );
+
+	auto zero = static_cast< const char* >( memchr( p, 0, end - p ) );
+	zero = zero ? zero : end;
+
+	cs.filter.Clear();
+	cs.filter.Append( { p, zero } );
+	cs.filter.Append('\0');
+
+	cs.options = data[0] & (Filter::ICASE | Filter::UTF8);
+
+	cs.limit = LineLimit();
+	if( data[0] & 0x80 )
+	{
+		cs.limit.length = data[1];
+		cs.limit.policy = data[0] & 0x40 ? LineLimit::SKIP : LineLimit::TRUNCATE;
+	}
+
+	cs.text.Clear();
+	cs.text.Append( { zero == end ? end : zero+1, end } );
+
+	Random random( data[2] + 1 );
+	Split( cs, random );
+
+	return true;
+}
+
+#ifdef LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput( const uint8_t* data, size_t size )
+{
+	Case cs;
+	if( Decode( data, size, cs ) && !Check(cs) )
+	{
+		fflush(stdout);
+		abort();
+	}
+
+	return 0;
+}
+
+#else
+
+// a random case: a short filter and lines of a few characters, the filter ones among them, so they match often
+static void Generate( Case& cs, Random& random )
+{
+	static const char* const PIECES[] = { "a", "b", "A", "B", "ab", "\xC3\xA9", "\xE4\xB8\xAD", "\xF0\x9F\x98\x80", "\xC3", "\xA9", "\x80", "\xFF", "*", "?" };
+	constexpr size_t WILDCARDS = 2, PIECES_NUMBER = sizeof(PIECES) / sizeof(*PIECES);
+
+	// some filters of the literal shapes, "abc", "abc*", "*abc" and "*abc*", which the matcher takes without the scan
+	const auto literal = !random.Below(4);
+	const auto anchors = random.Below(4);
+
+	cs.filter.Clear();
+	if( literal && anchors & 1 )
+	{
+		cs.filter.Append('*');
+	}
+
+	for( auto n = random.Below(8); n--; )
+	{
+		const char* piece = PIECES[ random.Below( literal ? PIECES_NUMBER - WILDCARDS : PIECES_NUMBER ) ];
+		cs.filter.Append( { piece, piece + strlen(piece) } );
+	}
+
+	if( literal && anchors & 2 )
+	{
+		cs.filter.Append('*');
+	}
+
+	cs.filter.Append('\0');
+
+	cs.options = (random.Below(2) ? unsigned( Filter::ICASE ) : 0) | (random.Below(2) ? unsigned( Filter::UTF8 ) : 0);
+
+	cs.limit = LineLimit();
+	if( !random.Below(4) )
+	{
+		cs.limit.length = random.Below(24);
+		cs.limit.policy = random.Below(2) ? LineLimit::SKIP : LineLimit::TRUNCATE;
+	}
+
+	// mostly short texts, some long enough for the workers, some with long lines
+	const auto kind = random.Below(64);
+	const size_t size = kind ? random.Below(kind < 8 ? 4096 : 256) : random.Below( 3 * CLogReader::BLOCK );
+	const size_t line = kind % 4 ? 16 : 1024;
+
+	cs.text.Clear();
+	while( cs.text.size() < size )
+	{
+		if( !random.Below(line) )
+		{
+			cs.text.Append('\n');
+			continue;
+		}
+
+		const char* piece = PIECES[ random.Below( PIECES_NUMBER - WILDCARDS ) ];
+		cs.text.Append( { piece, piece + strlen(piece) } );
+	}
+
+	Split( cs, random );
+}
+
+// the filters of the fixed bugs, checked before the random cases
+static bool Regressions()
+{
+	// in the UTF-8 mode the literal following a '*' was looked for by the bytes, a stray continuation byte of it
+	// matching inside a character: "*\xA9" took "\xC3\xA9"; such a filter is rejected, while the bytes match as usual
+	static const char* const FILTERS[] = { "*\xA9", "*\xA9*", "a*\xA9?", "*\x80\xA9", "\xC3", "*\xC3*" };
+	static const char TEXT[] = "\xC3\xA9\na\xC3\xA9\xC3\xA9\n\xC3\x80\xA9\nab\n";
+
+	Case cs;
+	cs.text.Append( { TEXT, TEXT + sizeof(TEXT) - 1 } );
+	cs.blocks.Append( cs.text.size() );
+
+	for( const auto filter : FILTERS )
+	{
+		Collector collector;
+		CLogReader reader(&collector);
+		if( reader.SetFilter( filter, Filter::UTF8 ) )
+		{
+			printf( "the reader takes a filter of invalid UTF-8\n" );
+			Dump( stdout, "filter", { filter, cs.filter.data().to - 1 } );
+			return false;
+		}
+
+		cs.filter.Clear();
+		cs.filter.Append( { filter, filter + strlen(filter) + 1 } );
+		cs.options = 0;
+
+		if( !Check(cs) )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main( int argc, const char* argv[] )
+{
+	size_t runs = 10000;
+	uint64_t seed = 1;
+	Buffer<const char*> inputs;
+
+	for( int i = 1; i < argc; ++i )
+	{
+		if( !strcmp( argv[i], "--runs" ) && i+1 < argc )
+		{
+			runs = strtoull( argv[++i], nullptr, 10 );
+		}
+		else if( !strcmp( argv[i], "--seed" ) && i+1 < argc )
+		{
+			seed = strtoull( argv[++i], nullptr, 10 );
+		}
+		else if( argv[i][0] != '-' )
+		{
+			inputs.Append( argv[i] );
+		}
+		else
+		{
+			printf( "usage: bench_fuzz [--runs <n>] [--seed <n>] [<input>...]\n" );
+			return 1;
+		}
+	}
+
+	Case cs;
+
+	if( !inputs.empty() )
+	{
+		for( const auto path : inputs.data() )
+		{
+			FILE* file = fopen( path, "rb" );
+			if( !file )
+			{
+				printf( "cannot open %s\n", path );
+				return 1;
+			}
+
+			Buffer<uint8_t> input;
+			uint8_t chunk[4096];
+			for( size_t n; (n = fread( chunk, 1, sizeof(chunk), file )); )
+			{
+				input.Append( {chunk, chunk + n} );
+			}
+
+			fclose(file);
+
+			if( Decode( input.data().from, input.size(), cs ) && !Check(cs) )
+			{
+				printf( "input %s\n", path );
+				return 1;
+			}
+		}
+
+		printf( "%zu inputs match the reference\n", inputs.size() );
+		return 0;
+	}
+
+	if( !Regressions() )
+	{
+		return 1;
+	}
+
+	Random random(seed);
+
+	for( size_t i = 0; i < runs; ++i )
+	{
+		Generate( cs, random );
+		if( !Check(cs) )
+		{
+			printf( "case %zu of the seed %llu\n", i, static_cast< unsigned long long >(seed) );
+			return 1;
+		}
+	}
+
+	printf( "%zu cases match the reference\n", runs );
+	return 0;
+}
+
+#endif // LIBFUZZER
@@ -0,0 +1,87 @@
+// writes a deterministic synthetic log
+// usage: loggen [--lengths fixed|uniform|lognormal|bimodal] [--length <n>] [--density <d>] [--seed <n>] <MB> <path>
+
+#include "corpus.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main( int argc, const char* argv[] )
+{
+	static const char USAGE[] =
+		"usage: loggen [--lengths fixed|uniform|lognormal|bimodal] [--length <n>] [--density <d>] [--seed <n>] <MB> <path>\n"
+		"  the lines of the given density contain the word ERROR\n";
+
+	Profile profile;
+
+	int i = 1;
+	for( ; i + 2 < argc; i += 2 )
+	{
+		const char* option = argv[i];
+		const char* value = argv[i+1];
+
+		if( !strcmp( option, "--lengths" ) && Profile::Parse( value, profile.lengths ) )
+		{
+		}
+		else if( !strcmp( option, "--length" ) && (profile.length = strtoull( value, nullptr, 10 )) )
+		{
+		}
+		else if( !strcmp( option, "--density" ) )
+		{
+			profile.density = atof(value);
+		}
+		else if( !strcmp( option, "--seed" ) )
+		{
+			profile.seed = strtoull( value, nullptr, 10 );
+		}
+		else
+		{
+			printf( "invalid option: %s\n%s", option, USAGE );
+			return 1;
+		}
+	}
+
+	if( argc - i != 2 )
+	{
+		printf( "%s", USAGE );
+		return 1;
+	}
+
+	const size_t size = strtoull( argv[i], nullptr, 10 ) << 20;
+	const char* path = argv[i+1];
+
+	FILE* file = !strcmp( path, "-" ) ? stdout : fopen( path, "w" );
+	if( !file )
+	{
+		printf( "cannot open the file %s\n", path );
+		return 1;
+	}
+
+	constexpr size_t CHUNK = 16 << 20;
+
+	Generator generator(profile);
+	Buffer<char> chunk;
+
+	for( size_t written = 0; written < size; )
+	{
+		chunk.Clear();
+		generator.Fill( chunk, size - written < CHUNK ? size - written : CHUNK );
+
+		if( fwrite( &chunk.front(), 1, chunk.size(), file ) != chunk.size() )
+		{
+			fprintf( stderr, "cannot write the file %s\n", path );
+			return 1;
+		}
+
+		written += chunk.size();
+	}
+
+	if( file != stdout )
+	{
+		fclose(file);
+	}
+
+	fprintf( stderr, "%zu lines, %zu matching\n", generator.lines, generator.matches );
+	return 0;
+}
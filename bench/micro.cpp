@@ -0,0 +1,315 @@
+// microbenchmarks of the building blocks of CLogReader on a synthetic corpus
+// usage: bench_micro [--size <MB>] [--runs <n>] [--json <path>] [--baseline <path> [--tolerance <percent>]]
+// with a baseline, the results of an earlier run on the same corpus, fails if the throughput of any drops by more
+// than the tolerance
+
+#include "corpus.h"
+#include "report.h"
+
+#include "logreader.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// access to the internals of CLogReader
+struct Probe
+{
+	using Results = CLogReader::Results;
+	using Printer = CLogReader::Printer;
+	using Line = CLogReader::Line;
+
+	static const char* Process( const Sequence<char>& text, const ExpressionMatcher& matcher, Results& results,
+		Newlines::Scanner* scanner = nullptr )
+	{
+		return CLogReader::Process( text, matcher, results, nullptr, scanner );
+	}
+};
+
+// compares the throughput to the baseline
+struct Gate
+{
+	void Check( const char* name, size_t bytes, double gbps );
+
+	Baseline baseline;
+	double tolerance = 10; // percent
+
+	size_t compared = 0, regressions = 0;
+};
+
+struct Options
+{
+	size_t size = 64 << 20;
+	size_t runs = 5;
+	const char* json = nullptr;
+	const char* baseline = nullptr;
+
+	Gate* gate = nullptr;
+};
+
+void Gate::Check( const char* name, size_t bytes, double gbps )
+{
+	double base, size;
+	if( !baseline.Find( name, "gbps", base ) || base <= 0 )
+	{
+		printf( "  not in the baseline\n" );
+		return;
+	}
+
+	// the corpus is the same for the same size, the generator is seeded by the profile; the size is written rounded
+	if( !baseline.Find( name, "bytes", size ) || fabs( size - bytes ) > bytes * 1e-5 )
+	{
+		printf( "  measured on another corpus in the baseline\n" );
+		return;
+	}
+
+	++compared;
+
+	const auto change = (gbps / base - 1) * 100;
+	if( change < -tolerance )
+	{
+		printf( "  regression: %.3f GB/s in the baseline, %.1f%%\n", base, change );
+		++regressions;
+	}
+}
+
+// runs the body several times and reports the best time
+template< typename Body >
+void Run( Report& report, const Options& options, const char* name, size_t bytes, size_t items, Body body )
+{
+	double best = 1e30;
+	for( size_t i = 0; i < options.runs; ++i )
+	{
+		const auto started = Now();
+		body();
+
+		const auto seconds = Now() - started;
+		best = seconds < best ? seconds : best;
+	}
+
+	printf( "%-24s %10.3f ms %8.3f GB/s %10.1f M items/s %8.2f ns/item\n", name, best * 1e3, bytes / best / 1e9,
+		items / best / 1e6, best * 1e9 / items );
+
+	report.Begin(name);
+	report.Field( "seconds", best );
+	report.Field( "bytes", double(bytes) );
+	report.Field( "items", double(items) );
+	report.Field( "gbps", bytes / best / 1e9 );
+	report.Field( "ns_per_item", best * 1e9 / items );
+	report.End();
+
+	if( options.gate )
+	{
+		options.gate->Check( name, bytes, bytes / best / 1e9 );
+	}
+}
+
+int main( int argc, const char* argv[] )
+{
+	Options options;
+	Gate gate;
+
+	for( int i = 1; i < argc; ++i )
+	{
+		if( !strcmp( argv[i], "--size" ) && i+1 < argc )
+		{
+			options.size = strtoull( argv[++i], nullptr, 10 ) << 20;
+		}
+		else if( !strcmp( argv[i], "--runs" ) && i+1 < argc )
+		{
+			options.runs = strtoull( argv[++i], nullptr, 10 );
+		}
+		else if( !strcmp( argv[i], "--json" ) && i+1 < argc )
+		{
+			options.json = argv[++i];
+		}
+		else if( !strcmp( argv[i], "--baseline" ) && i+1 < argc )
+		{
+			options.baseline = argv[++i];
+		}
+		else if( !strcmp( argv[i], "--tolerance" ) && i+1 < argc )
+		{
+			gate.tolerance = strtod( argv[++i], nullptr );
+		}
+		else
+		{
+			printf( "usage: bench_micro [--size <MB>] [--runs <n>] [--json <path>] [--baseline <path> [--tolerance <percent>]]\n" );
+			return 1;
+		}
+	}
+
+	if( !options.size || !options.runs )
+	{
+		printf( "the size and the number of runs must be positive\n" );
+		return 1;
+	}
+
+	if( options.baseline )
+	{
+		if( !gate.baseline.Load(options.baseline) )
+		{
+			printf( "cannot read the baseline %s\n", options.baseline );
+			return 1;
+		}
+
+		if( gate.tolerance <= 0 || gate.tolerance >= 100 )
+		{
+			printf( "the tolerance must be between 0 and 100 percent\n" );
+			return 1;
+		}
+
+		options.gate = &gate;
+	}
+
+#if !defined(__OPTIMIZE__)
+	printf( "warning: built without optimization, configure with -DCMAKE_BUILD_TYPE=Release\n" );
+#endif
+
+	Report report( "micro", options.json );
+	if( !report.ok() )
+	{
+		printf( "cannot write %s\n", options.json );
+		return 1;
+	}
+
+	Profile profile;
+	Generator generator(profile);
+
+	Buffer<char> corpus;
+	generator.Fill( corpus, options.size );
+
+	const auto text = corpus.data();
+	const auto bytes = text.length();
+	const auto lines = generator.lines;
+
+	printf( "corpus: %zu bytes, %zu lines, %zu matching\n", bytes, lines, generator.matches );
+
+	volatile size_t sink = 0; // keeps the results alive
+
+	// matching loop of a worker
+	ExpressionMatcher matcher;
+	matcher.Set( "*ERROR*" );
+
+	Run( report, options, "Process", bytes, lines, [&]
+	{
+		Probe::Results results;
+		Probe::Process( text, matcher, results );
+
+		size_t n = 0;
+		for( const auto& seq : results )
+		{
+			n += seq.length();
+		}
+
+		sink = n;
+	} );
+
+	// the same with the line breaks found in the bitmap built on the way, passing over the lines without "ERROR"
+	Newlines newlines;
+	Run( report, options, "Process (newlines)", bytes, lines, [&]
+	{
+		newlines.Reset(text);
+		Newlines::Scanner scanner( newlines, text );
+
+		Probe::Results results;
+		Probe::Process( text, matcher, results, &scanner );
+
+		size_t n = 0;
+		for( const auto& seq : results )
+		{
+			n += seq.length();
+		}
+
+		sink = n;
+	} );
+
+	// building the bitmap of the line breaks
+	Run( report, options, "Newlines::Build", bytes, bytes / 64, [&]
+	{
+		newlines.Reset(text);
+		newlines.Build( text.from, text.to );
+
+		sink = newlines.Previous( text.from, text.to ) - text.from;
+	} );
+
+	// looking up the line break preceding arbitrary positions in the bitmap built, as the workers start their slices
+	constexpr size_t STRIDE = 1009;
+	Run( report, options, "Newlines::Previous", bytes, bytes / STRIDE, [&]
+	{
+		size_t n = 0;
+		for( auto p = text.from; p < text.to; p += STRIDE )
+		{
+			const auto ln = newlines.Previous( text.from, p );
+			n += ln ? ln - text.from : 0;
+		}
+
+		sink = n;
+	} );
+
+	// collecting the results
+	Run( report, options, "Deque::Push", lines * sizeof(Probe::Line), lines, [&]
+	{
+		Probe::Results results;
+		for( size_t i = 0; i < lines; ++i )
+		{
+			results.Push( { {text.from, text.from + i}, i } );
+		}
+
+		sink = !results.empty();
+	} );
+
+	// copying the lines, like the unprocessed tail of a block, into a buffer of a steady capacity
+	Buffer<char> copy;
+	copy.Reserve(bytes);
+
+	Run( report, options, "Buffer::Append", bytes, lines, [&]
+	{
+		copy.Clear();
+		for( auto p = text.from; p != text.to; )
+		{
+			auto ln = static_cast< const char* >( memchr( p, '\n', text.to - p ) ) + 1;
+			copy.Append( {p, ln} );
+			p = ln;
+		}
+
+		sink = copy.size();
+	} );
+
+	// printing batches of the lines
+	Buffer<Probe::Line> batch;
+	size_t number = 0;
+
+	for( auto p = text.from; p != text.to; )
+	{
+		auto ln = static_cast< const char* >( memchr( p, '\n', text.to - p ) );
+		batch.Append( { {p, ln}, ++number } );
+		p = ln + 1;
+	}
+
+	Probe::Printer printer( "/dev/null" );
+	Run( report, options, "Printer::Handle", bytes, lines, [&]
+	{
+		const auto all = batch.data();
+		for( auto p = all.from; p < all.to; p += 128 )
+		{
+			printer.Handle( {p, p + 128 < all.to ? p + 128 : all.to} );
+		}
+	} );
+
+	if( !options.gate )
+	{
+		return 0;
+	}
+
+	if( !gate.compared )
+	{
+		printf( "no results to compare in the baseline, run with the same --size\n" );
+		return 1;
+	}
+
+	printf( "%zu of %zu results compared to the baseline dropped by more than %g%%\n", gate.regressions, gate.compared,
+		gate.tolerance );
+
+	return gate.regressions ? 1 : 0;
+}
@@ -0,0 +1,218 @@
+// throughput of CLogReader with the workers pinned by the affinity policies and the input placed
+// on the NUMA nodes of the workers processing it (local) or on another node (remote)
+// usage: bench_numa [--size <MB>] [--runs <n>] [--json <path>]
+
+#include "corpus.h"
+#include "report.h"
+
+#include "affinity.h"
+#include "logreader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// blocks are fed like the command-line tool reads them, split among the workers in about equal parts
+static constexpr size_t BLOCK = 4 * 1024 * 1024;
+
+struct Options
+{
+	size_t size = 256 << 20;
+	size_t runs = 3;
+	const char* json = nullptr;
+};
+
+struct Counter : public CLogReader::Handler
+{
+	void Handle( const Sequence<Line>& lines ) override { total += lines.length(); }
+
+	size_t total = 0;
+};
+
+enum Memory { FIRST, LOCAL, REMOTE };
+
+static const char* const MEMORY[] = { "first-touch", "local", "remote" };
+
+// a node having the allowed CPUs other than the given one, -1 if none
+static int Other( const Affinity& all, int node )
+{
+	for( size_t i = 0; i < all.size(); ++i )
+	{
+		if( all.Node(i) != node )
+		{
+			return all.Node(i);
+		}
+	}
+
+	return -1;
+}
+
+// binds the parts of every block to the nodes, returns false if not supported
+static bool Place( char* text, size_t size, const Affinity& affinity, const Affinity& all, Memory memory )
+{
+	for( size_t at = 0; at < size; at += BLOCK )
+	{
+		const auto block = size - at < BLOCK ? size - at : BLOCK;
+		for( size_t i = 0; i < CLogReader::WORKERS; ++i )
+		{
+			const auto node = memory == LOCAL ? affinity.Node(i) : Other( all, affinity.Node(i) );
+			const auto part = block / CLogReader::WORKERS;
+
+			if( !Affinity::Bind( text + at + part * i, part, node ) )
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+int main( int argc, const char* argv[] )
+{
+	Options options;
+	for( int i = 1; i < argc; ++i )
+	{
+		if( !strcmp( argv[i], "--size" ) && i+1 < argc )
+		{
+			options.size = strtoull( argv[++i], nullptr, 10 ) << 20;
+		}
+		else if( !strcmp( argv[i], "--runs" ) && i+1 < argc )
+		{
+			options.runs = strtoull( argv[++i], nullptr, 10 );
+		}
+		else if( !strcmp( argv[i], "--json" ) && i+1 < argc )
+		{
+			options.json = argv[++i];
+		}
+		else
+		{
+			printf( "usage: bench_numa [--size <MB>] [--runs <n>] [--json <path>]\n" );
+			return 1;
+		}
+	}
+
+	if( !options.size || !options.runs )
+	{
+		printf( "the size and the number of runs must be positive\n" );
+		return 1;
+	}
+
+#if !defined(__OPTIMIZE__)
+	printf( "warning: built without optimization, configure with -DCMAKE_BUILD_TYPE=Release\n" );
+#endif
+
+	Report report( "numa", options.json );
+	if( !report.ok() )
+	{
+		printf( "cannot write %s\n", options.json );
+		return 1;
+	}
+
+	Affinity all; // every allowed CPU, to find the nodes
+	all.Parse("compact");
+
+	printf( "%zu CPUs on %zu NUMA nodes\n", all.size(), all.nodes() );
+	if( all.nodes() < 2 )
+	{
+		printf( "a single node: the remote placement cannot be measured on this host\n" );
+	}
+
+	Profile profile;
+	Generator generator(profile);
+
+	Buffer<char> corpus;
+	generator.Fill( corpus, options.size );
+
+	// page-aligned, so the parts of the blocks can be bound to the nodes
+	void* memory;
+	const auto size = corpus.size();
+
+	if( posix_memalign( &memory, 4096, size ) )
+	{
+		printf( "out of memory\n" );
+		return 1;
+	}
+
+	auto text = static_cast< char* >(memory);
+	memcpy( text, corpus.data().from, size );
+	corpus = Buffer<char>();
+
+	printf( "corpus: %zu bytes, %zu lines, %zu matching\n", size, generator.lines, generator.matches );
+	printf( "%-10s %-12s %-24s %10s %10s\n", "policy", "memory", "cpus", "ms", "GB/s" );
+
+	const char* const policies[] = { "none", "compact", "scatter" };
+	for( auto policy : policies )
+	{
+		Affinity affinity;
+		const bool pinned = strcmp( policy, "none" ) && affinity.Parse(policy);
+
+		if( strcmp( policy, "none" ) && !pinned )
+		{
+			printf( "%-10s cannot pin on this host\n", policy );
+			continue;
+		}
+
+		for( int m = FIRST; m <= REMOTE; ++m )
+		{
+			const auto mem = static_cast< Memory >(m);
+			if( mem != FIRST && (!pinned || (mem == REMOTE && all.nodes() < 2)) )
+			{
+				continue;
+			}
+
+			if( mem != FIRST && !Place( text, size, affinity, all, mem ) )
+			{
+				printf( "%-10s %-12s cannot bind the memory on this host\n", policy, MEMORY[mem] );
+				continue;
+			}
+
+			char cpus[64] = "";
+			for( size_t i = 0; pinned && i < CLogReader::WORKERS; ++i )
+			{
+				const auto n = strlen(cpus);
+				snprintf( cpus + n, sizeof(cpus) - n, "%s%d/n%d", i ? "," : "", affinity.Cpu(i), affinity.Node(i) );
+			}
+
+			double best = 1e30;
+			size_t matches = 0;
+
+			for( size_t run = 0; run < options.runs; ++run )
+			{
+				Counter counter;
+				CLogReader reader(&counter);
+				reader.SetFilter( "*ERROR*" );
+				reader.SetAffinity( pinned ? &affinity : nullptr );
+
+				const auto started = Now();
+				for( size_t at = 0; at < size; at += BLOCK )
+				{
+					reader.AddSourceBlock( text + at, size - at < BLOCK ? size - at : BLOCK );
+				}
+
+				const auto seconds = Now() - started;
+				best = seconds < best ? seconds : best;
+				matches = counter.total;
+			}
+
+			if( matches != generator.matches )
+			{
+				printf( "%s %s: %zu matches instead of %zu\n", policy, MEMORY[mem], matches, generator.matches );
+				return 1;
+			}
+
+			printf( "%-10s %-12s %-24s %10.3f %10.3f\n", policy, MEMORY[mem], pinned ? cpus : "-", best * 1e3, size / best / 1e9 );
+
+			report.Begin( policy );
+			report.Field( "memory", MEMORY[mem] );
+			report.Field( "cpus", pinned ? cpus : "" );
+			report.Field( "seconds", best );
+			report.Field( "bytes", double(size) );
+			report.Field( "gbps", size / best / 1e9 );
+			report.End();
+		}
+	}
+
+	free(memory);
+	return 0;
+}
@@ -0,0 +1,181 @@
+#ifndef __REPORT_HEADER__
+#define __REPORT_HEADER__
+
+#include "basic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// writes the benchmark results as JSON for the regression tracking:
+// { "suite": "...", "results": [ { "name": "...", ... }, ... ] }
+class Report
+{
+public:
+	Report( const char* suite, const char* path ); // no output without a path
+	~Report();
+
+	Report( const Report& ) = delete;
+	Report& operator=( const Report& ) = delete;
+
+	bool ok() const { return !path || file; }
+
+	void Begin( const char* name ); // starts a result
+	void Field( const char* key, double value );
+	void Field( const char* key, const char* value );
+	void End();
+
+private:
+	void Key( const char* key );
+	void String( const char* value );
+
+	const char* const path;
+	FILE* file = nullptr;
+
+	bool first = true; // no results written yet
+};
+
+inline Report::Report( const char* suite, const char* pth ) : path(pth)
+{
+	if( path && (file = fopen( path, "w" )) )
+	{
+		fputs( "{\n  \"suite\": ", file );
+		String(suite);
+		fputs( ",\n  \"results\": [", file );
+	}
+}
+
+inline Report::~Report()
+{
+	if(file)
+	{
+		fputs( "\n  ]\n}\n", file );
+		fclose(file);
+	}
+}
+
+inline void Report::Begin( const char* name )
+{
+	if(file)
+	{
+		fputs( first ? "\n    { \"name\": " : ",\n    { \"name\": ", file );
+		String(name);
+		first = false;
+	}
+}
+
+inline void Report::Field( const char* key, double value )
+{
+	if(file)
+	{
+		Key(key);
+		fprintf( file, "%.6g", value );
+	}
+}
+
+inline void Report::Field( const char* key, const char* value )
+{
+	if(file)
+	{
+		Key(key);
+		String(value);
+	}
+}
+
+inline void Report::End()
+{
+	if(file)
+	{
+		fputs( " }", file );
+	}
+}
+
+inline void Report::Key( const char* key )
+{
+	fputs( ", ", file );
+	String(key);
+	fputs( ": ", file );
+}
+
+inline void Report::String( const char* value )
+{
+	fputc( '"', file );
+	for( auto p = value; *p; ++p )
+	{
+		if( *p == '"' || *p == '\\' )
+		{
+			fputc( '\\', file );
+		}
+
+		fputc( *p, file );
+	}
+
+	fputc( '"', file );
+}
+
+// the results written by a Report earlier, to compare the new ones to
+class Baseline
+{
+public:
+	bool Load( const char* path ); // returns false if it cannot be read
+
+	// the value of the field of the named result, false if there is none
+	bool Find( const char* name, const char* key, double& value ) const;
+
+private:
+	Buffer<char> json; // zero terminated
+};
+
+inline bool Baseline::Load( const char* path )
+{
+	FILE* file = fopen( path, "r" );
+	if( !file )
+	{
+		return false;
+	}
+
+	char chunk[4096];
+	for( size_t n; (n = fread( chunk, 1, sizeof(chunk), file )); )
+	{
+		json.Append( {chunk, chunk + n} );
+	}
+
+	const bool failed = ferror(file);
+	fclose(file);
+
+	json.Append('\0');
+	return !failed && strstr( json.data().from, "\"results\"" );
+}
+
+inline bool Baseline::Find( const char* name, const char* key, double& value ) const
+{
+	// a result takes a line, as written by Report
+	char pattern[512];
+	if( json.empty() || snprintf( pattern, sizeof(pattern), "{ \"name\": \"%s\"", name ) >= int( sizeof(pattern) ) )
+	{
+		return false;
+	}
+
+	const char* result = strstr( json.data().from, pattern );
+	if( !result )
+	{
+		return false;
+	}
+
+	const char* end = strchr( result, '}' );
+	if( snprintf( pattern, sizeof(pattern), "\"%s\": ", key ) >= int( sizeof(pattern) ) )
+	{
+		return false;
+	}
+
+	const char* field = strstr( result, pattern );
+	if( !field || field > end )
+	{
+		return false;
+	}
+
+	value = strtod( field + strlen(pattern), nullptr );
+	return true;
+}
+
+#endif // !__REPORT_HEADER__
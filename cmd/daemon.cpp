@@ -0,0 +1,912 @@
+#include "daemon.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // SIGPIPE is ignored instead
+#endif
+
+#ifdef __APPLE__
+#define st_mtim st_mtimespec
+#endif
+
+static const char BREAK[] = "--\n";
+
+struct Daemon::File
+{
+	char* path;
+	const char* data; // mapped, nullptr if empty
+	size_t size;
+
+	// the identity of the content, the file is mapped again when it changes
+	dev_t device;
+	ino_t inode;
+	timespec modified;
+
+	size_t users = 0;
+	bool listed = true; // dropped from the list when evicted or stale, unmapped when the last user releases it
+
+	Scan* waiting = nullptr; // queued but not started, the new queries of the file join it
+
+	File* next = nullptr;
+};
+
+struct Daemon::Query : CLogReader::Handler
+{
+	explicit Query( int fd ) : connection(fd), reader(this) {}
+	~Query() { close(connection); }
+
+	void Handle( const Sequence<Line>& ) override;
+	void HandleContext( const Sequence<Line>& ) override;
+	void Break() override;
+
+	void Print( const Sequence<Line>&, char separator );
+
+	void Send( Frame, const char* data, size_t length ); // the client is gone if it fails
+	void Flush() override; // sends the buffered output
+	void Finish( int status ); // sends the rest and the status
+
+	const int connection;
+	CLogReader reader;
+
+	bool count = false, numbers = false;
+	size_t total = 0; // matching lines
+
+	Buffer<char> output;
+	bool gone = false;
+};
+
+struct Daemon::Pending
+{
+	int connection;
+
+	char* request; // the arguments terminated by '\0' each, and an empty one at the end
+	size_t size;
+
+	double deadline; // of the monotonic clock, in seconds
+};
+
+struct Daemon::Scan
+{
+	File* file;
+
+	Query* queries[BATCH];
+	size_t count = 0;
+
+	Scan* next = nullptr;
+};
+
+// sends all the bytes, returns false if the peer is gone
+static bool SendAll( int fd, const char* data, size_t length )
+{
+	while(length)
+	{
+		const auto sent = send( fd, data, length, MSG_NOSIGNAL );
+		if( sent < 0 && errno == EINTR )
+		{
+			continue;
+		}
+
+		if( sent <= 0 )
+		{
+			return false;
+		}
+
+		data += sent;
+		length -= sent;
+	}
+
+	return true;
+}
+
+// receives exactly the number of bytes, returns false at the end or on an error
+static bool ReceiveAll( int fd, char* data, size_t length )
+{
+	while(length)
+	{
+		const auto received = recv( fd, data, length, 0 );
+		if( received < 0 && errno == EINTR )
+		{
+			continue;
+		}
+
+		if( received <= 0 )
+		{
+			return false;
+		}
+
+		data += received;
+		length -= received;
+	}
+
+	return true;
+}
+
+static bool SendFrame( int fd, Daemon::Frame type, const char* data, size_t length )
+{
+	const uint32_t n = static_cast< uint32_t >(length);
+	const char header[5] = { type, char( n ), char( n >> 8 ), char( n >> 16 ), char( n >> 24 ) };
+
+	return SendAll( fd, header, sizeof(header) ) && (!data || SendAll( fd, data, length ));
+}
+
+static double Seconds()
+{
+	timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static bool ParseCount( const char* text, size_t& count )
+{
+	char* end;
+	count = strtoull( text, &end, 10 );
+
+	return end != text && !*end;
+}
+
+void Daemon::Query::Handle( const Sequence<Line>& lines )
+{
+	if(count)
+	{
+		total += lines.length();
+		return;
+	}
+
+	Print( lines, ':' );
+}
+
+void Daemon::Query::HandleContext( const Sequence<Line>& lines )
+{
+	Print( lines, '-' );
+}
+
+void Daemon::Query::Break()
+{
+	if( !gone )
+	{
+		output.Append( { BREAK, BREAK + sizeof(BREAK) - 1 } );
+	}
+}
+
+void Daemon::Query::Print( const Sequence<Line>& lines, char separator )
+{
+	if(gone)
+	{
+		return;
+	}
+
+	for( const auto& line : lines )
+	{
+		if(numbers)
+		{
+			char number[32];
+			const auto n = snprintf( number, sizeof(number), "%zu%c", line.number, separator );
+			output.Append( { number, number + n } );
+		}
+
+		output.Append(line);
+		output.Append('\n');
+	}
+
+	if( output.size() >= OUTPUT )
+	{
+		Flush();
+	}
+}
+
+void Daemon::Query::Send( Frame type, const char* data, size_t length )
+{
+	gone = gone || !SendFrame( connection, type, data, length );
+}
+
+void Daemon::Query::Flush()
+{
+	if( !output.empty() )
+	{
+		Send( OUTPUT_FRAME, output.data().from, output.size() );
+		output.Clear();
+	}
+}
+
+void Daemon::Query::Finish( int status )
+{
+	if(count)
+	{
+		char number[32];
+		const auto n = snprintf( number, sizeof(number), "%zu\n", total );
+		output.Append( { number, number + n } );
+	}
+
+	Flush();
+	Send( EXIT_FRAME, nullptr, static_cast< size_t >(status) );
+}
+
+Daemon::Daemon()
+{
+	pthread_mutex_init( &mutex, nullptr );
+	pthread_cond_init( &queued, nullptr );
+}
+
+Daemon::~Daemon()
+{
+	pthread_mutex_lock(&mutex);
+	stop = true;
+	pthread_cond_broadcast(&queued);
+	pthread_mutex_unlock(&mutex);
+
+	for( size_t i = 0; i < running; ++i )
+	{
+		pthread_join( threads[i], nullptr );
+	}
+
+	for( auto scan = first; scan; )
+	{
+		const auto next = scan->next;
+		for( size_t i = 0; i < scan->count; ++i )
+		{
+			delete scan->queries[i];
+		}
+
+		delete scan;
+		scan = next;
+	}
+
+	while(files)
+	{
+		const auto file = files;
+		files = file->next;
+
+		if( file->data )
+		{
+			munmap( const_cast< char* >( file->data ), file->size );
+		}
+
+		free( file->path );
+		delete file;
+	}
+
+	if( listener >= 0 )
+	{
+		close(listener);
+	}
+
+	pthread_cond_destroy(&queued);
+	pthread_mutex_destroy(&mutex);
+}
+
+bool Daemon::Listen( const char* path )
+{
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+
+	if( strlen(path) >= sizeof( address.sun_path ) )
+	{
+		failure = "the path of the socket is too long";
+		return false;
+	}
+
+	strcpy( address.sun_path, path );
+
+	// a socket left by a previous run
+	struct stat st;
+	if( !stat( path, &st ) && S_ISSOCK( st.st_mode ) )
+	{
+		unlink(path);
+	}
+
+	listener = socket( AF_UNIX, SOCK_STREAM, 0 );
+	if( listener < 0 )
+	{
+		failure = "cannot create the socket";
+		return false;
+	}
+
+	signal( SIGPIPE, SIG_IGN ); // the clients may be gone
+
+	const auto mask = umask(077);
+	const auto bound = bind( listener, reinterpret_cast< sockaddr* >(&address), sizeof(address) );
+	umask(mask);
+
+	if( bound || listen( listener, 64 ) )
+	{
+		failure = "cannot listen on the socket";
+		close(listener);
+		listener = -1;
+
+		return false;
+	}
+
+	for( ; running < THREADS; ++running )
+	{
+		if( pthread_create( &threads[running], nullptr, Work, this ) )
+		{
+			break;
+		}
+	}
+
+	if( !running )
+	{
+		failure = "cannot start the threads";
+		return false;
+	}
+
+	return true;
+}
+
+void Daemon::Run()
+{
+	assert( listener >= 0 );
+
+	// the queries are received as they arrive, a client slow to send its one does not hold up the others
+	Pending pending[PENDING];
+	size_t count = 0;
+
+	pollfd polled[ PENDING + 1 ];
+
+	for( ;; )
+	{
+		// the connections beyond the pending ones wait in the backlog
+		const bool accepting = count < PENDING;
+
+		size_t n = 0;
+		for( size_t i = 0; i < count; ++i )
+		{
+			polled[ n++ ] = { pending[i].connection, POLLIN, 0 };
+		}
+
+		if(accepting)
+		{
+			polled[ n++ ] = { listener, POLLIN, 0 };
+		}
+
+		if( poll( polled, n, count ? 1000 : -1 ) < 0 )
+		{
+			if( errno == EINTR )
+			{
+				continue;
+			}
+
+			failure = "cannot poll the connections";
+			return;
+		}
+
+		const auto now = Seconds();
+
+		// from the last, so the one moved in place of a finished one has been seen
+		for( size_t i = count; i--; )
+		{
+			auto& query = pending[i];
+			if( !(polled[i].revents && Receive(query)) && now < query.deadline )
+			{
+				continue;
+			}
+
+			Accept( query.connection, query.request, query.size );
+			delete[] query.request;
+
+			query = pending[ --count ];
+		}
+
+		if( !accepting || !polled[ n-1 ].revents )
+		{
+			continue;
+		}
+
+		const int connection = accept( listener, nullptr, nullptr );
+		if( connection < 0 )
+		{
+			if( errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE )
+			{
+				continue;
+			}
+
+			failure = "cannot accept the connections";
+			return;
+		}
+
+		pending[ count++ ] = { connection, new char[REQUEST], 0, now + TIMEOUT };
+	}
+}
+
+// the arguments are complete once an empty one follows them
+static bool Complete( const char* request, size_t size )
+{
+	return size == 1 ? !request[0] : size >= 2 && !request[ size-1 ] && !request[ size-2 ];
+}
+
+bool Daemon::Receive( Pending& query )
+{
+	for( ;; )
+	{
+		const auto received = recv( query.connection, query.request + query.size, REQUEST - query.size, MSG_DONTWAIT );
+		if( received < 0 && errno == EINTR )
+		{
+			continue;
+		}
+
+		if( received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) )
+		{
+			return false;
+		}
+
+		if( received <= 0 )
+		{
+			return true; // gone, or an error
+		}
+
+		query.size += received;
+		return query.size == REQUEST || Complete( query.request, query.size );
+	}
+}
+
+void Daemon::Accept( int connection, const char* request, size_t size )
+{
+	auto query = new Query(connection);
+
+	if( !Complete( request, size ) )
+	{
+		const char message[] = "invalid query\n";
+		query->Send( ERROR_FRAME, message, sizeof(message) - 1 );
+		query->Send( EXIT_FRAME, nullptr, 1 );
+
+		delete query;
+		return;
+	}
+
+	const char* path;
+	File* file = nullptr;
+
+	if( Parse( *query, request, size, path ) )
+	{
+		const char* error = nullptr;
+		if( !(file = Map( path, &error )) )
+		{
+			char message[512];
+			const auto n = snprintf( message, sizeof(message), "cannot read the file %s: %s\n", path, error );
+
+			query->Send( ERROR_FRAME, message, n < int( sizeof(message) ) ? n : sizeof(message) - 1 );
+		}
+	}
+
+	if( !file )
+	{
+		query->Send( EXIT_FRAME, nullptr, 1 );
+		delete query;
+
+		return;
+	}
+
+	pthread_mutex_lock(&mutex);
+
+	if( file->waiting && file->waiting->count < BATCH )
+	{
+		auto scan = file->waiting;
+		scan->queries[ scan->count++ ] = query;
+
+		--file->users; // retained by the scan
+	}
+	else
+	{
+		auto scan = new Scan;
+		scan->file = file;
+		scan->queries[ scan->count++ ] = query;
+
+		file->waiting = scan;
+
+		(last ? last->next : first) = scan;
+		last = scan;
+
+		pthread_cond_signal(&queued);
+	}
+
+	pthread_mutex_unlock(&mutex);
+}
+
+bool Daemon::Parse( Query& query, const char* request, size_t size, const char*& path )
+{
+	// the arguments
+	const char* args[64];
+	size_t n = 0;
+
+	for( auto p = request; p < request + size - 1 && n < 64; p += strlen(p) + 1 )
+	{
+		args[ n++ ] = p;
+	}
+
+	unsigned flags = 0;
+	const char* field = nullptr;
+	size_t before = 0, after = 0;
+
+	size_t i = 0;
+	for( ; i < n && args[i][0] == '-' && args[i][1]; ++i )
+	{
+		const char* option = args[i];
+		const char* value = i+1 < n ? args[i+1] : nullptr;
+
+		if( !strcmp( option, "--" ) )
+		{
+			++i;
+			break;
+		}
+		else if( !strcmp( option, "-i" ) || !strcmp( option, "--ignore-case" ) )
+		{
+			flags |= Filter::ICASE;
+		}
+		else if( !strcmp( option, "-u" ) || !strcmp( option, "--utf8" ) )
+		{
+			flags |= Filter::UTF8;
+		}
+		else if( !strcmp( option, "--expr" ) )
+		{
+			flags |= Filter::EXPRESSION;
+		}
+		else if( !strcmp( option, "-c" ) || !strcmp( option, "--count" ) )
+		{
+			query.count = true;
+		}
+		else if( !strcmp( option, "-n" ) || !strcmp( option, "--line-number" ) )
+		{
+			query.numbers = true;
+		}
+		else if( !strcmp( option, "--field" ) && value )
+		{
+			field = value;
+			++i;
+		}
+		else if( !strcmp( option, "-B" ) && value && ParseCount( value, before ) )
+		{
+			++i;
+		}
+		else if( !strcmp( option, "-A" ) && value && ParseCount( value, after ) )
+		{
+			++i;
+		}
+		else if( !strcmp( option, "-C" ) && value && ParseCount( value, before ) )
+		{
+			after = before;
+			++i;
+		}
+		else
+		{
+			char message[256];
+			const auto length = snprintf( message, sizeof(message), "invalid option for the daemon: %.200s\n", option );
+
+			query.Send( ERROR_FRAME, message, length );
+			return false;
+		}
+	}
+
+	if( n - i != 2 || args[ i+1 ][0] != '/' )
+	{
+		const char message[] = "the daemon takes the options, the filter and the absolute path of a file\n";
+		query.Send( ERROR_FRAME, message, sizeof(message) - 1 );
+
+		return false;
+	}
+
+	if( !query.reader.SetFilter( args[i], flags ) || !query.reader.SetField(field) )
+	{
+		const char message[] = "invalid filter or field\n";
+		query.Send( ERROR_FRAME, message, sizeof(message) - 1 );
+
+		return false;
+	}
+
+	if( !query.count )
+	{
+		query.reader.SetContext( before, after );
+	}
+
+	path = args[ i+1 ];
+	return true;
+}
+
+Daemon::File* Daemon::Map( const char* path, const char** error )
+{
+	struct stat st;
+	if( stat( path, &st ) || !S_ISREG( st.st_mode ) )
+	{
+		*error = "cannot open";
+		return nullptr;
+	}
+
+	pthread_mutex_lock(&mutex);
+
+	// the mapped file if it has not changed, moved to the front
+	File* stale = nullptr;
+	for( File** link = &files; *link; link = &(*link)->next )
+	{
+		const auto file = *link;
+		if( strcmp( file->path, path ) )
+		{
+			continue;
+		}
+
+		*link = file->next;
+
+		if( file->device == st.st_dev && file->inode == st.st_ino && file->size == size_t( st.st_size ) &&
+			file->modified.tv_sec == st.st_mtim.tv_sec && file->modified.tv_nsec == st.st_mtim.tv_nsec )
+		{
+			file->next = files;
+			files = file;
+			++file->users;
+
+			pthread_mutex_unlock(&mutex);
+			return file;
+		}
+
+		// changed, unmapped by its last user
+		stale = file;
+		stale->listed = false;
+		stale->waiting = nullptr;
+		++stale->users;
+		--mapped;
+
+		break;
+	}
+
+	pthread_mutex_unlock(&mutex);
+
+	if(stale)
+	{
+		Release(stale);
+	}
+
+	const int fd = open( path, O_RDONLY );
+	if( fd < 0 )
+	{
+		*error = "cannot open";
+		return nullptr;
+	}
+
+	const char* data = nullptr;
+	if( st.st_size )
+	{
+		auto address = mmap( nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+		if( address == MAP_FAILED )
+		{
+			close(fd);
+
+			*error = "cannot map";
+			return nullptr;
+		}
+
+		madvise( address, st.st_size, MADV_SEQUENTIAL );
+		data = static_cast< const char* >(address);
+	}
+
+	close(fd);
+
+	auto file = new File;
+	file->path = strdup(path);
+	file->data = data;
+	file->size = st.st_size;
+	file->device = st.st_dev;
+	file->inode = st.st_ino;
+	file->modified = st.st_mtim;
+	file->users = 1;
+
+	pthread_mutex_lock(&mutex);
+
+	file->next = files;
+	files = file;
+
+	// evicts the least recently used files beyond the limit
+	File* evicted = nullptr;
+	if( ++mapped > FILES )
+	{
+		auto link = &files;
+		for( size_t i = 0; i < FILES; ++i )
+		{
+			link = &(*link)->next;
+		}
+
+		evicted = *link;
+		*link = nullptr;
+
+		for( auto other = evicted; other; other = other->next )
+		{
+			other->listed = false;
+			other->waiting = nullptr;
+			++other->users;
+			--mapped;
+		}
+	}
+
+	pthread_mutex_unlock(&mutex);
+
+	while(evicted)
+	{
+		const auto next = evicted->next;
+		Release(evicted);
+
+		evicted = next;
+	}
+
+	return file;
+}
+
+void Daemon::Release( File* file )
+{
+	pthread_mutex_lock(&mutex);
+	const bool unused = !--file->users && !file->listed;
+	pthread_mutex_unlock(&mutex);
+
+	if(unused)
+	{
+		if( file->data )
+		{
+			munmap( const_cast< char* >( file->data ), file->size );
+		}
+
+		free( file->path );
+		delete file;
+	}
+}
+
+void* Daemon::Work( void* param )
+{
+	reinterpret_cast< Daemon* >(param)->Work();
+	return nullptr;
+}
+
+void Daemon::Work()
+{
+	for( ;; )
+	{
+		pthread_mutex_lock(&mutex);
+		while( !first && !stop )
+		{
+			pthread_cond_wait( &queued, &mutex );
+		}
+
+		if(stop)
+		{
+			pthread_mutex_unlock(&mutex);
+			return;
+		}
+
+		auto scan = first;
+		first = scan->next;
+		last = first ? last : nullptr;
+
+		// no more queries join once it has started
+		if( scan->file->waiting == scan )
+		{
+			scan->file->waiting = nullptr;
+		}
+
+		pthread_mutex_unlock(&mutex);
+
+		Execute(*scan);
+		delete scan;
+	}
+}
+
+void Daemon::Execute( Scan& scan )
+{
+	const auto& file = *scan.file;
+
+	// every block is matched against all the filters while it is in the cache
+	for( size_t offset = 0; offset < file.size; offset += BLOCK )
+	{
+		const auto length = file.size - offset < BLOCK ? file.size - offset : BLOCK;
+
+		size_t live = 0;
+		for( size_t i = 0; i < scan.count; ++i )
+		{
+			auto& query = *scan.queries[i];
+			if( !query.gone )
+			{
+				query.reader.AddSourceBlock( file.data + offset, length );
+				++live;
+			}
+		}
+
+		if( !live )
+		{
+			break;
+		}
+	}
+
+	for( size_t i = 0; i < scan.count; ++i )
+	{
+		auto query = scan.queries[i];
+
+		// complete the last line
+		if( file.size && file.data[ file.size-1 ] != '\n' && !query->gone )
+		{
+			query->reader.AddSourceBlock( "\n", 1 );
+		}
+
+		query->Finish(0);
+		delete query;
+	}
+
+	Release( scan.file );
+}
+
+int Daemon::Request( const char* path, const char* const* args, size_t count, FILE* out, FILE* err )
+{
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+
+	if( strlen(path) >= sizeof( address.sun_path ) )
+	{
+		return -1;
+	}
+
+	strcpy( address.sun_path, path );
+
+	const int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+	if( fd < 0 || connect( fd, reinterpret_cast< sockaddr* >(&address), sizeof(address) ) )
+	{
+		if( fd >= 0 )
+		{
+			close(fd);
+		}
+
+		return -1;
+	}
+
+	bool sent = true;
+	for( size_t i = 0; i < count && sent; ++i )
+	{
+		sent = SendAll( fd, args[i], strlen( args[i] ) + 1 );
+	}
+
+	sent = sent && SendAll( fd, "", 1 );
+
+	char* buffer = new char[OUTPUT];
+	int status = -1;
+
+	char header[5];
+	while( sent && ReceiveAll( fd, header, sizeof(header) ) )
+	{
+		size_t length = uint8_t( header[1] ) | uint8_t( header[2] ) << 8 | uint8_t( header[3] ) << 16 | size_t( uint8_t( header[4] ) ) << 24;
+
+		if( header[0] == EXIT_FRAME )
+		{
+			status = static_cast< int >(length);
+			break;
+		}
+
+		// the output in pieces, the frames are not larger than the buffered output unless a line is
+		while(length)
+		{
+			const auto piece = length < OUTPUT ? length : OUTPUT;
+			if( !ReceiveAll( fd, buffer, piece ) )
+			{
+				length = SIZE_MAX;
+				break;
+			}
+
+			fwrite( buffer, 1, piece, header[0] == ERROR_FRAME ? err : out );
+			length -= piece;
+		}
+
+		if( length == SIZE_MAX )
+		{
+			break;
+		}
+	}
+
+	delete[] buffer;
+	close(fd);
+
+	return status;
+}
@@ -0,0 +1,85 @@
+#ifndef __DAEMON_HEADER__
+#define __DAEMON_HEADER__
+
+#include "logreader.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+// Serves the queries of the clients over a Unix domain socket, keeping the files mapped between them.
+// A query is the command line of the client: the options, the filter and the absolute path of a file; the matching
+// lines are streamed back in frames as they are found. The queries waiting for the same file are batched into
+// a shared scan: the file is read once, block by block, and every block is matched against the filters of all of them
+// while it is in the cache. The scans are run by a pool of threads started once, the mapped files are kept until
+// evicted by the least recently used order or changed on the disk.
+// Every reply frame is a type byte and a 32-bit little-endian length: OUTPUT and ERROR with that many bytes of text
+// following, EXIT with the status of the query in place of the length, the last frame.
+class Daemon
+{
+public:
+	static constexpr size_t THREADS = 4; // scans run at once
+	static constexpr size_t FILES = 16; // mapped files kept
+	static constexpr size_t BATCH = 32; // maximum queries per scan
+	static constexpr size_t BLOCK = 4 * 1024 * 1024; // passed to the readers at once
+	static constexpr size_t REQUEST = 64 * 1024; // maximum size of a query
+	static constexpr size_t OUTPUT = 64 * 1024; // buffered per query before a frame is sent
+	static constexpr size_t PENDING = 64; // connections whose queries are being received at once
+	static constexpr double TIMEOUT = 5; // seconds for a client to send its query
+
+	enum Frame : char { OUTPUT_FRAME = 'o', ERROR_FRAME = 'e', EXIT_FRAME = 'x' };
+
+	Daemon();
+	~Daemon();
+
+	Daemon( const Daemon& ) = delete;
+	Daemon& operator=( const Daemon& ) = delete;
+
+	bool Listen( const char* path ); // creates the socket, accessible to the owner only
+	void Run(); // accepts the queries until the process is terminated
+
+	const char* error() const { return failure; } // nullptr if no error
+
+	// sends the arguments to the daemon listening on the socket and writes the reply to the files,
+	// returns the status of the query, or -1 if the daemon cannot be reached
+	static int Request( const char* path, const char* const* args, size_t count, FILE* out, FILE* err );
+
+private:
+	struct File; // a mapped one
+	struct Query;
+	struct Scan; // a batch of the queries of a file
+	struct Pending; // a connection whose query is being received
+
+	static void* Work( void* param ); // thread func
+	void Work();
+
+	bool Receive( Pending& ); // reads what has arrived, returns true once the query is complete or cannot be
+	void Accept( int connection, const char* request, size_t size ); // queues the query, or replies to an invalid one
+	bool Parse( Query&, const char* request, size_t size, const char*& path ); // sets up the reader, sends the error if invalid
+
+	File* Map( const char* path, const char** error ); // a mapped file, retained by the caller
+	void Release( File* );
+
+	void Execute( Scan& );
+
+	int listener = -1;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t queued;
+
+	File* files = nullptr; // the most recently used first
+	size_t mapped = 0;
+
+	Scan* first = nullptr; // waiting to be run, in order
+	Scan* last = nullptr;
+
+	pthread_t threads[THREADS];
+	size_t running = 0;
+	bool stop = false;
+
+	const char* failure = nullptr;
+};
+
+#endif // !__DAEMON_HEADER__
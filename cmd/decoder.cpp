@@ -0,0 +1,580 @@
+#include "decoder.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(LOGREADER_ZLIB)
+#include <zlib.h>
+#endif
+
+#if defined(LOGREADER_ZSTD)
+#include <zstd.h>
+#endif
+
+struct Decoder::Stream
+{
+	~Stream()
+	{
+#if defined(LOGREADER_ZLIB)
+		if(inflating)
+		{
+			inflateEnd(&z);
+		}
+#endif
+#if defined(LOGREADER_ZSTD)
+		ZSTD_freeDStream(zstd);
+#endif
+	}
+
+	bool active = false; // in the middle of a member
+
+#if defined(LOGREADER_ZLIB)
+	z_stream z = {};
+	bool inflating = false; // z is initialized
+#endif
+#if defined(LOGREADER_ZSTD)
+	ZSTD_DStream* zstd = nullptr;
+#endif
+};
+
+Decoder::Format Decoder::Detect( const char* path )
+{
+	FILE* file = fopen( path, "r" );
+	if( !file )
+	{
+		return PLAIN;
+	}
+
+	uint8_t magic[4] = {};
+	const auto n = fread( magic, 1, sizeof(magic), file );
+	fclose(file);
+
+	if( n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b )
+	{
+		return GZIP;
+	}
+
+	if( n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd )
+	{
+		return ZSTD;
+	}
+
+	return PLAIN;
+}
+
+bool Decoder::Supported( Format format )
+{
+	switch(format)
+	{
+	case PLAIN:
+		return true;
+
+	case GZIP:
+#if defined(LOGREADER_ZLIB)
+		return true;
+#else
+		return false;
+#endif
+
+	case ZSTD:
+#if defined(LOGREADER_ZSTD)
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	return false;
+}
+
+Decoder::Decoder()
+{
+	pthread_mutex_init( &mutex, nullptr );
+	pthread_cond_init( &changed, nullptr );
+}
+
+Decoder::~Decoder()
+{
+	pthread_mutex_lock(&mutex);
+	stop = true;
+	pthread_cond_broadcast(&changed);
+	pthread_mutex_unlock(&mutex);
+
+	if(running)
+	{
+		pthread_join( producer, nullptr );
+		for( auto& thread : threads )
+		{
+			pthread_join( thread, nullptr );
+		}
+	}
+
+	if(input)
+	{
+		munmap( const_cast< uint8_t* >(input), size );
+	}
+
+	pthread_cond_destroy(&changed);
+	pthread_mutex_destroy(&mutex);
+}
+
+bool Decoder::Open( const char* path )
+{
+	assert( !input );
+
+	format = Detect(path);
+	if( format == PLAIN || !Supported(format) )
+	{
+		failure = format == PLAIN ? "not compressed" : "the compression is not supported by this build";
+		return false;
+	}
+
+	const int fd = open( path, O_RDONLY );
+	struct stat st;
+
+	if( fd < 0 || fstat( fd, &st ) )
+	{
+		failure = "cannot open";
+		if( fd >= 0 )
+		{
+			close(fd);
+		}
+
+		return false;
+	}
+
+	auto mapped = mmap( nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close(fd);
+
+	if( mapped == MAP_FAILED )
+	{
+		failure = "cannot map";
+		return false;
+	}
+
+	madvise( mapped, st.st_size, MADV_SEQUENTIAL );
+
+	input = cursor = static_cast< const uint8_t* >(mapped);
+	size = st.st_size;
+
+	running = true;
+
+	[[maybe_unused]] auto err = pthread_create( &producer, nullptr, Produce, this );
+	assert( !err );
+
+	for( auto& thread : threads )
+	{
+		err = pthread_create( &thread, nullptr, Work, this );
+		assert( !err );
+	}
+
+	return true;
+}
+
+Sequence<char> Decoder::Next()
+{
+	pthread_mutex_lock(&mutex);
+
+	for( ;; )
+	{
+		if(holding)
+		{
+			slots[ consumed % SLOTS ].state = Slot::FREE;
+			++consumed;
+			holding = false;
+
+			pthread_cond_broadcast(&changed);
+		}
+
+		auto& slot = slots[ consumed % SLOTS ];
+		while( consumed == produced || slot.state != Slot::READY )
+		{
+			pthread_cond_wait( &changed, &mutex );
+		}
+
+		if( slot.last )
+		{
+			pthread_mutex_unlock(&mutex);
+			return {};
+		}
+
+		holding = true;
+		if( !slot.data.empty() )
+		{
+			pthread_mutex_unlock(&mutex);
+			return slot.data.data();
+		}
+	}
+}
+
+void* Decoder::Produce( void* param )
+{
+	reinterpret_cast< Decoder* >(param)->Produce();
+	return nullptr;
+}
+
+void* Decoder::Work( void* param )
+{
+	reinterpret_cast< Decoder* >(param)->Work();
+	return nullptr;
+}
+
+void Decoder::Produce()
+{
+	Stream stream;
+	const auto end = input + size;
+
+	while( auto slot = Acquire() )
+	{
+		size_t decompressed;
+		if( cursor == end )
+		{
+			slot->last = true;
+			Publish( Slot::READY );
+			break;
+		}
+		else if( !stream.active && Member( cursor, decompressed ) )
+		{
+			// a batch of the independent members for the pool
+			slot->from = cursor;
+
+			size_t total = 0;
+			for( size_t n; total < CHUNK && cursor != end && (n = Member( cursor, decompressed )); cursor += n )
+			{
+				total += decompressed;
+			}
+
+			slot->to = cursor;
+			Publish( Slot::QUEUED );
+		}
+		else if( Fill( stream, *slot ) )
+		{
+			Publish( Slot::READY );
+		}
+		else
+		{
+			Fail( "corrupt or truncated compressed data" );
+
+			slot->last = true;
+			Publish( Slot::READY );
+			break;
+		}
+	}
+}
+
+void Decoder::Work()
+{
+	pthread_mutex_lock(&mutex);
+
+	while( !stop )
+	{
+		// the queued slots are taken in order, skipping the ones of the sequential members
+		taken = taken < consumed ? consumed : taken;
+		for( ; taken < produced && slots[ taken % SLOTS ].state != Slot::QUEUED; ++taken );
+
+		if( taken == produced )
+		{
+			pthread_cond_wait( &changed, &mutex );
+			continue;
+		}
+
+		auto& slot = slots[ taken++ % SLOTS ];
+		slot.state = Slot::BUSY;
+
+		pthread_mutex_unlock(&mutex);
+		const bool ok = Decode(slot);
+		pthread_mutex_lock(&mutex);
+
+		if( !ok )
+		{
+			// reported when the consumer reaches the slot
+			failure = "corrupt compressed data";
+			slot.data.Clear();
+			slot.last = true;
+		}
+
+		slot.state = Slot::READY;
+		pthread_cond_broadcast(&changed);
+	}
+
+	pthread_mutex_unlock(&mutex);
+}
+
+size_t Decoder::Member( const uint8_t* at, size_t& decompressed ) const
+{
+	const size_t left = input + size - at;
+
+	switch(format)
+	{
+	case GZIP:
+	{
+		// a BGZF block: the header has the extra subfield 'BC' with the block size, the trailer has the decompressed size
+		if( left < 18 || at[0] != 0x1f || at[1] != 0x8b || at[2] != 8 || !(at[3] & 4) )
+		{
+			return 0;
+		}
+
+		const size_t xlen = at[10] | at[11] << 8;
+		if( 12 + xlen > left )
+		{
+			return 0;
+		}
+
+		for( auto p = at + 12; p + 4 <= at + 12 + xlen; )
+		{
+			const size_t slen = p[2] | p[3] << 8;
+			if( p[0] == 'B' && p[1] == 'C' && slen == 2 && p + 6 <= at + 12 + xlen )
+			{
+				const size_t total = (p[4] | p[5] << 8) + 1;
+				if( total > left || total < 12 + xlen + 8 )
+				{
+					return 0;
+				}
+
+				// the size is not to be trusted before the member is inflated, a larger one is taken sequentially
+				const auto trailer = at + total - 4;
+				decompressed = size_t( trailer[0] ) | size_t( trailer[1] ) << 8 | size_t( trailer[2] ) << 16 | size_t( trailer[3] ) << 24;
+
+				return decompressed > LIMIT ? 0 : total;
+			}
+
+			p += 4 + slen;
+		}
+
+		return 0;
+	}
+
+	case ZSTD:
+	{
+#if defined(LOGREADER_ZSTD)
+		// check the header before walking the blocks of a possibly huge frame
+		const auto content = ZSTD_getFrameContentSize( at, left );
+		if( content == ZSTD_CONTENTSIZE_UNKNOWN || content == ZSTD_CONTENTSIZE_ERROR || content > LIMIT )
+		{
+			return 0;
+		}
+
+		const auto total = ZSTD_findFrameCompressedSize( at, left );
+		if( ZSTD_isError(total) )
+		{
+			return 0;
+		}
+
+		decompressed = content;
+		return total;
+#else
+		return 0;
+#endif
+	}
+
+	case PLAIN:
+		break;
+	}
+
+	return 0;
+}
+
+bool Decoder::Decode( Slot& slot ) const
+{
+	size_t total = 0, decompressed;
+	for( auto p = slot.from; p != slot.to; )
+	{
+		p += Member( p, decompressed );
+		total += decompressed;
+	}
+
+	slot.data.Resize(total);
+
+	auto out = &slot.data.front();
+	bool ok = true;
+
+	if( format == GZIP )
+	{
+#if defined(LOGREADER_ZLIB)
+		z_stream z = {};
+		if( inflateInit2( &z, 16 + MAX_WBITS ) != Z_OK )
+		{
+			return false;
+		}
+
+		for( auto p = slot.from; ok && p != slot.to; )
+		{
+			const auto n = Member( p, decompressed );
+
+			inflateReset(&z);
+			z.next_in = const_cast< uint8_t* >(p);
+			z.avail_in = n;
+			z.next_out = reinterpret_cast< uint8_t* >(out);
+			z.avail_out = decompressed;
+
+			ok = inflate( &z, Z_FINISH ) == Z_STREAM_END && !z.avail_out;
+
+			p += n;
+			out += decompressed;
+		}
+
+		inflateEnd(&z);
+#endif
+	}
+	else if( format == ZSTD )
+	{
+#if defined(LOGREADER_ZSTD)
+		auto dctx = ZSTD_createDCtx();
+		for( auto p = slot.from; ok && p != slot.to; )
+		{
+			const auto n = Member( p, decompressed );
+			ok = ZSTD_decompressDCtx( dctx, out, decompressed, p, n ) == decompressed;
+
+			p += n;
+			out += decompressed;
+		}
+
+		ZSTD_freeDCtx(dctx);
+#endif
+	}
+
+	return ok;
+}
+
+bool Decoder::Fill( Stream& stream, Slot& slot )
+{
+	const auto end = input + size;
+
+	slot.data.Resize(CHUNK);
+	auto out = reinterpret_cast< uint8_t* >( &slot.data.front() );
+
+	size_t filled = 0;
+
+	if( format == GZIP )
+	{
+#if defined(LOGREADER_ZLIB)
+		auto& z = stream.z;
+		if( !stream.inflating )
+		{
+			if( inflateInit2( &z, 16 + MAX_WBITS ) != Z_OK )
+			{
+				return false;
+			}
+
+			stream.inflating = true;
+		}
+		else if( !stream.active )
+		{
+			inflateReset(&z);
+		}
+
+		stream.active = true;
+
+		z.next_in = const_cast< uint8_t* >(cursor);
+		z.next_out = out;
+		z.avail_out = CHUNK;
+
+		while( z.avail_out )
+		{
+			const size_t available = end - z.next_in;
+			z.avail_in = available < 0xffffffffu ? available : 0xffffffffu;
+
+			const auto ret = inflate( &z, Z_NO_FLUSH );
+			if( ret == Z_STREAM_END )
+			{
+				stream.active = false;
+				break;
+			}
+
+			if( ret != Z_OK )
+			{
+				return false; // Z_BUF_ERROR means a truncated input here
+			}
+		}
+
+		cursor = z.next_in;
+		filled = CHUNK - z.avail_out;
+#endif
+	}
+	else if( format == ZSTD )
+	{
+#if defined(LOGREADER_ZSTD)
+		if( !stream.zstd && !(stream.zstd = ZSTD_createDStream()) )
+		{
+			return false;
+		}
+
+		if( !stream.active )
+		{
+			ZSTD_initDStream( stream.zstd );
+			stream.active = true;
+		}
+
+		ZSTD_inBuffer in = { cursor, size_t( end - cursor ), 0 };
+		ZSTD_outBuffer output = { out, CHUNK, 0 };
+
+		while( output.pos < output.size )
+		{
+			const auto ret = ZSTD_decompressStream( stream.zstd, &output, &in );
+			if( ZSTD_isError(ret) )
+			{
+				return false;
+			}
+
+			if( !ret )
+			{
+				stream.active = false; // the end of the frame
+				break;
+			}
+
+			if( in.pos == in.size && output.pos < output.size )
+			{
+				return false; // truncated
+			}
+		}
+
+		cursor += in.pos;
+		filled = output.pos;
+#endif
+	}
+
+	slot.data.Resize(filled);
+	return true;
+}
+
+Decoder::Slot* Decoder::Acquire()
+{
+	pthread_mutex_lock(&mutex);
+
+	auto& slot = slots[ produced % SLOTS ];
+	while( !stop && slot.state != Slot::FREE )
+	{
+		pthread_cond_wait( &changed, &mutex );
+	}
+
+	const bool ok = !stop;
+	if(ok)
+	{
+		slot.state = Slot::BUSY;
+		slot.last = false;
+	}
+
+	pthread_mutex_unlock(&mutex);
+	return ok ? &slot : nullptr;
+}
+
+void Decoder::Publish( Slot::State state )
+{
+	pthread_mutex_lock(&mutex);
+
+	slots[ produced % SLOTS ].state = state;
+	++produced;
+
+	pthread_cond_broadcast(&changed);
+	pthread_mutex_unlock(&mutex);
+}
+
+void Decoder::Fail( const char* message )
+{
+	pthread_mutex_lock(&mutex);
+	failure = message;
+	pthread_mutex_unlock(&mutex);
+}
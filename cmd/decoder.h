@@ -0,0 +1,90 @@
+#ifndef __DECODER_HEADER__
+#define __DECODER_HEADER__
+
+#include "basic.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Streams the decompressed content of a gzip or zstd file in order, decompressing ahead of the consumer.
+// The file is a sequence of members (gzip) or frames (zstd). The independent ones with the decompressed size
+// known in advance, i.e. BGZF blocks (bgzip) and zstd frames with the content size (pzstd, zstd -B),
+// are decompressed in parallel by a pool of threads. The others are decompressed sequentially in pieces.
+// Built with gzip support if zlib is found (LOGREADER_ZLIB) and with zstd support if libzstd is (LOGREADER_ZSTD).
+class Decoder
+{
+public:
+	enum Format { PLAIN, GZIP, ZSTD };
+
+	static constexpr size_t THREADS = 4; // pool threads decompressing the independent members
+	static constexpr size_t SLOTS = 2 * (THREADS + 1); // pieces decompressed ahead
+	static constexpr size_t CHUNK = 2 * 1024 * 1024; // approximate size of a piece
+	static constexpr size_t LIMIT = 8 * CHUNK; // maximum size of a member decompressed as a whole
+
+	static Format Detect( const char* path ); // PLAIN if neither or cannot open
+	static bool Supported( Format );
+
+	Decoder();
+	~Decoder();
+
+	Decoder( const Decoder& ) = delete;
+	Decoder& operator=( const Decoder& ) = delete;
+
+	bool Open( const char* path );
+
+	// returns the next piece of the content, empty at the end or on an error
+	// the piece is valid until the next call
+	Sequence<char> Next();
+
+	const char* error() const { return failure; } // nullptr if no error
+
+private:
+	struct Slot
+	{
+		enum State { FREE, QUEUED, BUSY, READY } state = FREE;
+
+		const uint8_t *from, *to; // the members of a QUEUED one
+		Buffer<char> data;
+
+		bool last = false; // no more content after this one
+	};
+
+	struct Stream; // sequential decompression state
+
+	static void* Produce( void* param ); // thread funcs
+	static void* Work( void* param );
+
+	void Produce();
+	void Work();
+
+	size_t Member( const uint8_t* at, size_t& decompressed ) const; // size of an independent member at the position, or 0
+	bool Decode( Slot& ) const; // decompresses the independent members of the slot
+	bool Fill( Stream&, Slot& ); // decompresses the next piece of the sequential member, updates the cursor
+
+	Slot* Acquire(); // waits for the next free slot on the producer side
+	void Publish( Slot::State ); // makes the acquired slot available
+	void Fail( const char* );
+
+	Format format = PLAIN;
+
+	const uint8_t* input = nullptr; // mapped file
+	size_t size = 0;
+	const uint8_t* cursor = nullptr; // the first member not decompressed yet
+
+	Slot slots[SLOTS];
+	size_t produced = 0, consumed = 0, taken = 0; // sequence numbers of the slots
+	bool holding = false; // the consumer holds the slot 'consumed'
+	bool stop = false;
+
+	const char* failure = nullptr;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t changed;
+
+	pthread_t producer;
+	pthread_t threads[THREADS];
+	bool running = false;
+};
+
+#endif // !__DECODER_HEADER__
@@ -0,0 +1,197 @@
+#include "estimator.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// asks the kernel to read the block ahead, the map is otherwise read page by page
+static void Advise( const char* input, size_t size, size_t offset, size_t length )
+{
+	static const size_t page = static_cast< size_t >( sysconf(_SC_PAGESIZE) );
+
+	const auto from = offset / page * page;
+	const auto to = offset + length + 1 < size ? offset + length + 1 : size;
+
+	madvise( const_cast< char* >(input) + from, to - from, MADV_WILLNEED );
+}
+
+Estimator::Estimator( const ExpressionMatcher& mtchr, const LineLimit& lmt ) : matcher(mtchr), limit(lmt)
+{
+}
+
+bool Estimator::Run( const char* path, double fraction, Result& result )
+{
+	assert( fraction > 0 && fraction <= 1 );
+
+	const int fd = open( path, O_RDONLY );
+
+	struct stat st;
+	if( fd < 0 || fstat( fd, &st ) )
+	{
+		failure = "cannot open";
+		if( fd >= 0 )
+		{
+			close(fd);
+		}
+
+		return false;
+	}
+
+	size = st.st_size;
+	result = {};
+	result.size = size;
+	result.exact = true;
+
+	if( !size )
+	{
+		close(fd);
+		return true;
+	}
+
+	auto mapped = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close(fd);
+
+	if( mapped == MAP_FAILED )
+	{
+		failure = "cannot map";
+		return false;
+	}
+
+	input = static_cast< const char* >(mapped);
+	madvise( mapped, size, MADV_RANDOM ); // no read-ahead beyond the sampled blocks
+
+	// one block per stratum, all the blocks if the sample would cover the file anyway
+	const size_t population = (size + BLOCK - 1) / BLOCK;
+	count = static_cast< size_t >( ceil( fraction * population ) );
+
+	result.exact = count >= population;
+	count = result.exact ? population : count;
+
+	samples = new Sample[count];
+
+	const auto stratum = result.exact ? BLOCK : size / count;
+	uint64_t state = size | 1; // xorshift, the same sample of the same file
+
+	for( size_t i = 0; i < count; ++i )
+	{
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+
+		auto& sample = samples[i];
+		sample.offset = stratum * i;
+		sample.length = size - sample.offset < BLOCK ? size - sample.offset : BLOCK;
+
+		if( !result.exact )
+		{
+			sample.offset += (state * 0x2545F4914F6CDD1Dull) % (stratum - BLOCK + 1);
+		}
+	}
+
+	Thread threads[THREADS];
+	const auto n = count < THREADS ? count : THREADS;
+
+	for( size_t i = 0; i < n; ++i )
+	{
+		threads[i].owner = this;
+		threads[i].index = i;
+
+		[[maybe_unused]] auto err = pthread_create( &threads[i].thread, nullptr, Work, &threads[i] );
+		assert( !err );
+	}
+
+	for( size_t i = 0; i < n; ++i )
+	{
+		pthread_join( threads[i].thread, nullptr );
+	}
+
+	// the counts of the lines starting within a block of the file, averaged and extrapolated
+	double matches = 0, lines = 0;
+	size_t covered = 0; // the end of the bytes read by the preceding samples, the last line of one may run into the next
+
+	for( size_t i = 0; i < count; ++i )
+	{
+		const auto& sample = samples[i];
+
+		matches += sample.matches;
+		lines += sample.lines;
+
+		const auto from = sample.offset > covered ? sample.offset : covered;
+		const auto to = sample.offset + sample.read;
+
+		result.read += to > from ? to - from : 0;
+		covered = to > covered ? to : covered;
+	}
+
+	const double blocks = result.exact ? 1 : double(size) / BLOCK;
+	const double mean = result.exact ? matches : matches / count;
+
+	double variance = 0;
+	for( size_t i = 0; i < count; ++i )
+	{
+		variance += (samples[i].matches - mean) * (samples[i].matches - mean);
+	}
+
+	variance = count > 1 ? variance / (count - 1) : 0;
+
+	result.blocks = count;
+	result.matches = mean * blocks;
+	result.lines = result.exact ? lines : lines / count * blocks;
+
+	// with the finite population correction, 1.96 standard errors
+	const double correction = 1 - count / blocks > 0 ? 1 - count / blocks : 0;
+	result.margin = result.exact ? 0 : count > 1 ? 1.96 * blocks * sqrt( correction * variance / count ) : INFINITY;
+
+	delete[] samples;
+	samples = nullptr;
+
+	munmap( mapped, size );
+	input = nullptr;
+
+	return true;
+}
+
+void* Estimator::Work( void* param )
+{
+	auto thread = reinterpret_cast< Thread* >(param);
+	thread->owner->Work( thread->index );
+
+	return nullptr;
+}
+
+void Estimator::Work( size_t index )
+{
+	if( index < count )
+	{
+		Advise( input, size, samples[index].offset, samples[index].length );
+	}
+
+	Newlines newlines; // of the block
+
+	for( auto i = index; i < count; i += THREADS )
+	{
+		if( i + THREADS < count )
+		{
+			Advise( input, size, samples[ i + THREADS ].offset, samples[ i + THREADS ].length );
+		}
+
+		Count( samples[i], newlines );
+	}
+}
+
+void Estimator::Count( Sample& sample, Newlines& newlines ) const
+{
+	const char* const block = input + sample.offset;
+
+	size_t lines;
+	const char* end;
+
+	sample.matches = CLogReader::Sample( {input, input + size}, {block, block + sample.length}, matcher, limit, newlines,
+		lines, end );
+
+	sample.lines = lines;
+	sample.read = end - block;
+}
@@ -0,0 +1,70 @@
+#ifndef __ESTIMATOR_HEADER__
+#define __ESTIMATOR_HEADER__
+
+#include "logreader.h"
+
+#include <pthread.h>
+#include <stddef.h>
+
+// Estimates the number of the matching lines of a file by reading only a sample of it.
+// The file is divided into equal strata and a block at a random position within each is sampled
+// through a memory map; the lines starting within the blocks are matched by a few threads in parallel,
+// by the matching loop of the workers of CLogReader, and the counts are extrapolated to the whole file with a 95% confidence interval from their variance.
+class Estimator
+{
+public:
+	static constexpr size_t THREADS = 4;
+	static constexpr size_t BLOCK = 1024 * 1024; // sampled at once
+
+	struct Result
+	{
+		double matches, lines; // estimated for the whole file
+		double margin; // half-width of the 95% confidence interval of the matches
+
+		size_t blocks; // sampled
+		size_t read; // bytes, the overlaps of the samples counted once
+		size_t size; // of the file
+
+		bool exact; // the whole file was read
+	};
+
+	Estimator( const ExpressionMatcher&, const LineLimit& );
+
+	// samples about the fraction of the file, 0 < fraction <= 1
+	bool Run( const char* path, double fraction, Result& );
+
+	const char* error() const { return failure; } // nullptr if no error
+
+private:
+	struct Sample
+	{
+		size_t offset, length; // of the block
+		size_t matches, lines; // starting within the block
+		size_t read; // bytes, up to the end of the last line
+	};
+
+	struct Thread
+	{
+		Estimator* owner;
+		size_t index;
+		pthread_t thread;
+	};
+
+	static void* Work( void* param ); // thread func
+	void Work( size_t index );
+
+	void Count( Sample&, Newlines& ) const;
+
+	const ExpressionMatcher& matcher;
+	const LineLimit limit;
+
+	const char* input = nullptr; // mapped file
+	size_t size = 0;
+
+	Sample* samples = nullptr;
+	size_t count = 0;
+
+	const char* failure = nullptr;
+};
+
+#endif // !__ESTIMATOR_HEADER__
@@ -0,0 +1,642 @@
+#include "loader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+// a minimal io_uring client: reads are submitted one by one and completions are waited for one by one
+class Loader::Ring
+{
+public:
+	~Ring();
+
+	bool Init( unsigned entries );
+
+	bool Submit( int file, char* buffer, size_t length, size_t offset, uint64_t data );
+	bool Wait( uint64_t& data, long& result );
+
+	size_t inflight = 0;
+
+private:
+#if defined(__linux__)
+	int fd = -1;
+
+	void* sq = MAP_FAILED;
+	void* cq = MAP_FAILED;
+	size_t sqsize = 0, cqsize = 0;
+
+	io_uring_sqe* sqes = static_cast< io_uring_sqe* >(MAP_FAILED);
+	size_t sqessize = 0;
+
+	unsigned *sqtail, *sqmask, *sqarray;
+	unsigned *cqhead, *cqtail, *cqmask;
+	io_uring_cqe* cqes;
+#endif
+};
+
+#if defined(__linux__)
+
+Loader::Ring::~Ring()
+{
+	if( sqes != MAP_FAILED )
+	{
+		munmap( sqes, sqessize );
+	}
+
+	if( cq != MAP_FAILED && cq != sq )
+	{
+		munmap( cq, cqsize );
+	}
+
+	if( sq != MAP_FAILED )
+	{
+		munmap( sq, sqsize );
+	}
+
+	if( fd >= 0 )
+	{
+		close(fd);
+	}
+}
+
+bool Loader::Ring::Init( unsigned entries )
+{
+	io_uring_params params;
+	memset( &params, 0, sizeof(params) );
+
+	fd = syscall( __NR_io_uring_setup, entries, &params );
+	if( fd < 0 )
+	{
+		return false; // not supported by the kernel or not allowed
+	}
+
+	// IORING_OP_READ appeared in the same kernel release as the fast poll
+	if( !(params.features & IORING_FEAT_FAST_POLL) )
+	{
+		return false;
+	}
+
+	sqsize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqsize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+	const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+	if(single)
+	{
+		sqsize = cqsize = sqsize > cqsize ? sqsize : cqsize;
+	}
+
+	sq = mmap( nullptr, sqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+	if( sq == MAP_FAILED )
+	{
+		return false;
+	}
+
+	cq = single ? sq : mmap( nullptr, cqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING );
+	if( cq == MAP_FAILED )
+	{
+		return false;
+	}
+
+	sqessize = params.sq_entries * sizeof(io_uring_sqe);
+	sqes = static_cast< io_uring_sqe* >( mmap( nullptr, sqessize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES ) );
+	if( sqes == MAP_FAILED )
+	{
+		return false;
+	}
+
+	auto sqbase = static_cast< char* >(sq);
+	sqtail = reinterpret_cast< unsigned* >( sqbase + params.sq_off.tail );
+	sqmask = reinterpret_cast< unsigned* >( sqbase + params.sq_off.ring_mask );
+	sqarray = reinterpret_cast< unsigned* >( sqbase + params.sq_off.array );
+
+	auto cqbase = static_cast< char* >(cq);
+	cqhead = reinterpret_cast< unsigned* >( cqbase + params.cq_off.head );
+	cqtail = reinterpret_cast< unsigned* >( cqbase + params.cq_off.tail );
+	cqmask = reinterpret_cast< unsigned* >( cqbase + params.cq_off.ring_mask );
+	cqes = reinterpret_cast< io_uring_cqe* >( cqbase + params.cq_off.cqes );
+
+	return true;
+}
+
+bool Loader::Ring::Submit( int file, char* buffer, size_t length, size_t offset, uint64_t data )
+{
+	const unsigned tail = *sqtail; // written only here
+	const unsigned index = tail & *sqmask;
+
+	auto& sqe = sqes[index];
+	memset( &sqe, 0, sizeof(sqe) );
+
+	sqe.opcode = IORING_OP_READ;
+	sqe.fd = file;
+	sqe.addr = reinterpret_cast< uint64_t >(buffer);
+	sqe.len = length;
+	sqe.off = offset;
+	sqe.user_data = data;
+
+	sqarray[index] = index;
+	__atomic_store_n( sqtail, tail + 1, __ATOMIC_RELEASE );
+
+	long submitted;
+	while( (submitted = syscall( __NR_io_uring_enter, fd, 1, 0, 0, nullptr, 0 )) < 0 && errno == EINTR );
+
+	inflight += submitted == 1;
+	return submitted == 1;
+}
+
+bool Loader::Ring::Wait( uint64_t& data, long& result )
+{
+	for( ;; )
+	{
+		const unsigned head = *cqhead; // written only here
+		if( head != __atomic_load_n( cqtail, __ATOMIC_ACQUIRE ) )
+		{
+			const auto& cqe = cqes[ head & *cqmask ];
+			data = cqe.user_data;
+			result = cqe.res;
+
+			__atomic_store_n( cqhead, head + 1, __ATOMIC_RELEASE );
+
+			--inflight;
+			return true;
+		}
+
+		if( syscall( __NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0 ) < 0 && errno != EINTR )
+		{
+			return false;
+		}
+	}
+}
+
+#else
+
+Loader::Ring::~Ring()
+{
+}
+
+bool Loader::Ring::Init( unsigned )
+{
+	return false;
+}
+
+bool Loader::Ring::Submit( int, char*, size_t, size_t, uint64_t )
+{
+	return false;
+}
+
+bool Loader::Ring::Wait( uint64_t&, long& )
+{
+	return false;
+}
+
+#endif
+
+Loader::Loader( Backend prfrd, bool drct ) : preferred(prfrd), direct(drct)
+{
+	pthread_mutex_init( &mutex, nullptr );
+	pthread_cond_init( &changed, nullptr );
+}
+
+Loader::~Loader()
+{
+	pthread_mutex_lock(&mutex);
+	stop = true;
+	pthread_cond_broadcast(&changed);
+	pthread_mutex_unlock(&mutex);
+
+	if(running)
+	{
+		pthread_join( thread, nullptr );
+	}
+
+	if(ring)
+	{
+		// the kernel may still be writing to the buffers
+		uint64_t data;
+		long result;
+		while( ring->inflight && ring->Wait( data, result ) );
+
+		delete ring;
+	}
+
+	for( auto& slot : slots )
+	{
+		free( slot.data );
+	}
+
+	if( fd >= 0 )
+	{
+		close(fd);
+	}
+
+	pthread_cond_destroy(&changed);
+	pthread_mutex_destroy(&mutex);
+}
+
+void Loader::SetAffinity( const Affinity* afnt, size_t prts )
+{
+	assert( fd < 0 && prts );
+
+	affinity = afnt;
+	parts = prts;
+}
+
+bool Loader::Open( const char* path, size_t offset )
+{
+	assert( fd < 0 );
+
+	bool aligned = false;
+#if defined(O_DIRECT)
+	if(direct)
+	{
+		fd = open( path, O_RDONLY | O_DIRECT );
+		aligned = fd >= 0; // the file system may not support it
+	}
+#endif
+
+	if( fd < 0 )
+	{
+		fd = open( path, O_RDONLY );
+	}
+
+	struct stat st;
+	if( fd < 0 || fstat( fd, &st ) )
+	{
+		failure = "cannot open";
+		return false;
+	}
+
+	size = st.st_size;
+	start = aligned ? offset & ~(ALIGNMENT - 1) : offset;
+	skip = offset - start;
+	total = start < size ? (size - start + BLOCK - 1) / BLOCK : 0;
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+	if( !aligned )
+	{
+		posix_fadvise( fd, start, 0, POSIX_FADV_SEQUENTIAL );
+	}
+#endif
+
+	if( !Allocate() )
+	{
+		return false;
+	}
+
+	if( preferred == URING )
+	{
+		ring = new Ring;
+		if( !ring->Init(SLOTS) )
+		{
+			delete ring;
+			ring = nullptr;
+		}
+	}
+
+	used = ring ? URING : PREAD;
+
+	if(ring)
+	{
+		for( size_t i = 0; i < SLOTS && i < total; ++i )
+		{
+			Submit(i);
+		}
+	}
+	else
+	{
+		running = true;
+
+		[[maybe_unused]] auto err = pthread_create( &thread, nullptr, Work, this );
+		assert( !err );
+	}
+
+	return true;
+}
+
+bool Loader::Open( int file )
+{
+	assert( fd < 0 );
+
+	fd = dup(file); // closed independently of the original
+	if( fd < 0 )
+	{
+		failure = "cannot open";
+		return false;
+	}
+
+	streaming = true;
+	size = total = SIZE_MAX; // until the end is reached
+
+#if defined(F_SETPIPE_SZ)
+	// a larger pipe buffer lets the writer run ahead and the reads be larger,
+	// the unprivileged limit is in /proc/sys/fs/pipe-max-size
+	if( fcntl( fd, F_GETPIPE_SZ ) > 0 )
+	{
+		int limit = 1024 * 1024;
+		if( FILE* max = fopen( "/proc/sys/fs/pipe-max-size", "r" ) )
+		{
+			if( fscanf( max, "%d", &limit ) != 1 )
+			{
+				limit = 1024 * 1024;
+			}
+
+			fclose(max);
+		}
+
+		fcntl( fd, F_SETPIPE_SZ, limit < int(BLOCK) ? limit : int(BLOCK) );
+	}
+#endif
+
+	if( !Allocate() )
+	{
+		return false;
+	}
+
+	used = PREAD;
+	running = true;
+
+	[[maybe_unused]] auto err = pthread_create( &thread, nullptr, Work, this );
+	assert( !err );
+
+	return true;
+}
+
+bool Loader::Allocate()
+{
+	for( auto& slot : slots )
+	{
+		void* data;
+		if( posix_memalign( &data, ALIGNMENT, BLOCK ) )
+		{
+			failure = "out of memory";
+			return false;
+		}
+
+		slot.data = static_cast< char* >(data);
+
+		// before the first read, so the pages are allocated on the nodes
+		for( size_t i = 0; affinity && i < parts; ++i )
+		{
+			affinity->Place( slot.data + BLOCK / parts * i, BLOCK / parts, i );
+		}
+	}
+
+	return true;
+}
+
+Sequence<char> Loader::Next()
+{
+	if(ring)
+	{
+		if(holding)
+		{
+			holding = false;
+			if( ++consumed + SLOTS - 1 < total && !failure )
+			{
+				Submit( consumed + SLOTS - 1 );
+			}
+		}
+
+		if( consumed == total )
+		{
+			return {};
+		}
+
+		auto& slot = slots[ consumed % SLOTS ];
+		while( !failure && slot.state != Slot::READY )
+		{
+			uint64_t index;
+			long result;
+			if( !ring->Wait( index, result ) )
+			{
+				failure = "cannot wait for the reads";
+				break;
+			}
+
+			auto& done = slots[index];
+			if( Complete( done, result ) )
+			{
+				done.state = Slot::READY;
+			}
+			else
+			{
+				// read the rest
+				if( !ring->Submit( fd, done.data + done.filled, done.length - done.filled, done.offset + done.filled, index ) )
+				{
+					failure = "cannot submit a read";
+				}
+			}
+		}
+
+		if(failure)
+		{
+			return {};
+		}
+
+		holding = true;
+		return Block(slot);
+	}
+
+	pthread_mutex_lock(&mutex);
+
+	if(holding)
+	{
+		slots[ consumed % SLOTS ].state = Slot::FREE;
+		++consumed;
+		holding = false;
+
+		pthread_cond_broadcast(&changed);
+	}
+
+	if( consumed == total )
+	{
+		pthread_mutex_unlock(&mutex);
+		return {};
+	}
+
+	auto& slot = slots[ consumed % SLOTS ];
+	while( slot.state != Slot::READY )
+	{
+		pthread_cond_wait( &changed, &mutex );
+	}
+
+	pthread_mutex_unlock(&mutex);
+
+	if(failure)
+	{
+		return {};
+	}
+
+	holding = true;
+	return Block(slot);
+}
+
+void* Loader::Work( void* param )
+{
+	reinterpret_cast< Loader* >(param)->Work();
+	return nullptr;
+}
+
+void Loader::Work()
+{
+	for( size_t sequence = 0; sequence < total; ++sequence )
+	{
+		auto& slot = slots[ sequence % SLOTS ];
+
+		pthread_mutex_lock(&mutex);
+		while( !stop && slot.state != Slot::FREE )
+		{
+			pthread_cond_wait( &changed, &mutex );
+		}
+
+		if( !stop )
+		{
+			Prepare(sequence);
+		}
+
+		pthread_mutex_unlock(&mutex);
+
+		if(stop)
+		{
+			return;
+		}
+
+		bool more = true;
+		if(streaming)
+		{
+			more = Receive(slot);
+		}
+		else
+		{
+			for( ;; )
+			{
+				const auto result = pread( fd, slot.data + slot.filled, slot.length - slot.filled, slot.offset + slot.filled );
+				if( Complete( slot, result < 0 ? -errno : result ) )
+				{
+					break;
+				}
+			}
+		}
+
+		pthread_mutex_lock(&mutex);
+		if( !more )
+		{
+			total = slot.filled ? sequence+1 : sequence;
+		}
+
+		slot.state = Slot::READY;
+		pthread_cond_broadcast(&changed);
+		pthread_mutex_unlock(&mutex);
+
+		if( failure || !more )
+		{
+			return;
+		}
+	}
+}
+
+Loader::Slot& Loader::Prepare( size_t sequence )
+{
+	auto& slot = slots[ sequence % SLOTS ];
+
+	slot.state = Slot::PENDING;
+	slot.offset = start + sequence * BLOCK;
+	slot.filled = 0;
+
+	// the direct reads are whole aligned blocks, a read past the end of the file is short
+	const auto left = size - slot.offset;
+	slot.length = left < BLOCK ? (left + ALIGNMENT - 1) & ~(ALIGNMENT - 1) : BLOCK;
+
+	return slot;
+}
+
+void Loader::Submit( size_t sequence )
+{
+	auto& slot = Prepare(sequence);
+	if( !ring->Submit( fd, slot.data, slot.length, slot.offset, sequence % SLOTS ) )
+	{
+		failure = "cannot submit a read";
+	}
+}
+
+bool Loader::Complete( Slot& slot, long result )
+{
+	if( result == -EINTR || result == -EAGAIN )
+	{
+		return false; // retry
+	}
+
+	if( result < 0 )
+	{
+		failure = "read error";
+	}
+	else
+	{
+		slot.filled += result;
+
+		// a short read before the end of the file
+		if( result && slot.filled < slot.length && slot.offset + slot.filled < size )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool Loader::Receive( Slot& slot )
+{
+	for( ;; )
+	{
+		const auto result = read( fd, slot.data + slot.filled, slot.length - slot.filled );
+		if( result < 0 && errno == EAGAIN )
+		{
+			// a non-blocking descriptor
+			pollfd ready{ fd, POLLIN, 0 };
+			poll( &ready, 1, -1 );
+		}
+		else if( result < 0 && errno != EINTR )
+		{
+			failure = "read error";
+			return false;
+		}
+		else if( !result )
+		{
+			return false;
+		}
+		else if( result > 0 )
+		{
+			slot.filled += result;
+			if( slot.filled == slot.length )
+			{
+				return true;
+			}
+
+			// pass on what has arrived if the writer is slower, so the lines are not held back
+			pollfd ready{ fd, POLLIN, 0 };
+			if( poll( &ready, 1, 0 ) == 0 )
+			{
+				return true;
+			}
+		}
+	}
+}
+
+Sequence<char> Loader::Block( const Slot& slot ) const
+{
+	// the file could have been truncated
+	const auto filled = slot.offset + slot.filled <= size ? slot.filled : size - slot.offset;
+	const auto from = slot.offset == start ? (skip < filled ? skip : filled) : 0;
+
+	return { slot.data + from, slot.data + filled };
+}
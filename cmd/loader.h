@@ -0,0 +1,101 @@
+#ifndef __LOADER_HEADER__
+#define __LOADER_HEADER__
+
+#include "affinity.h"
+#include "basic.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Reads a file block by block in order, keeping several large reads in flight to saturate fast storage
+// when the file is not in the page cache. On Linux the reads are submitted through io_uring, otherwise
+// or when it is not available a read-ahead thread issues them with pread.
+// A pipe or another stream is read sequentially on the read-ahead thread, a block is passed on when it is full
+// or no more input is ready.
+// Optionally reads with O_DIRECT into aligned buffers, bypassing the page cache, and places the parts of
+// the buffers on the NUMA nodes of the workers processing them.
+class Loader
+{
+public:
+	static constexpr size_t SLOTS = 4; // blocks in flight, one of them is held by the consumer
+	static constexpr size_t BLOCK = 4 * 1024 * 1024;
+	static constexpr size_t ALIGNMENT = 4096; // of the buffers and the direct reads
+
+	enum Backend { URING, PREAD };
+
+	explicit Loader( Backend preferred = URING, bool direct = false );
+	~Loader();
+
+	Loader( const Loader& ) = delete;
+	Loader& operator=( const Loader& ) = delete;
+
+	// places the i-th of the equal parts of every block on the node of the i-th worker, call before Open
+	void SetAffinity( const Affinity*, size_t parts );
+
+	bool Open( const char* path, size_t offset = 0 );
+	bool Open( int stream ); // e.g. the standard input, the descriptor remains open
+
+	// returns the next block of the file, empty at the end or on an error
+	// the block is valid until the next call
+	Sequence<char> Next();
+
+	const char* error() const { return failure; } // nullptr if no error
+	Backend backend() const { return used; }
+
+private:
+	struct Slot
+	{
+		enum State { FREE, PENDING, READY } state = FREE;
+
+		char* data = nullptr;
+		size_t offset; // in the file
+		size_t length; // requested
+		size_t filled; // read so far
+	};
+
+	class Ring; // io_uring submission and completion queues
+
+	static void* Work( void* param ); // thread func
+	void Work();
+
+	bool Allocate(); // the buffers of the slots
+
+	Slot& Prepare( size_t sequence ); // sets up the slot for reading the block with the sequence number
+	void Submit( size_t sequence ); // starts reading the block into its slot with io_uring
+	bool Complete( Slot&, long result ); // accounts a read, returns false if the slot needs more reading
+	bool Receive( Slot& ); // reads the stream into the slot, returns false at the end or on an error
+
+	Sequence<char> Block( const Slot& ) const; // the content of a ready slot
+
+	const Backend preferred;
+	const bool direct;
+
+	const Affinity* affinity = nullptr;
+	size_t parts = 1;
+
+	Backend used = PREAD;
+
+	int fd = -1;
+	size_t size = 0; // of the file
+	size_t start = 0; // offset of the first block
+	size_t skip = 0; // bytes to skip in the first block, due to the alignment
+	bool streaming = false; // the size is unknown until the end
+
+	size_t total = 0; // number of the blocks
+	size_t consumed = 0; // sequence number of the block being consumed
+	bool holding = false; // the consumer holds the slot 'consumed'
+	bool stop = false;
+
+	Slot slots[SLOTS];
+	Ring* ring = nullptr;
+
+	const char* failure = nullptr;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t changed;
+	pthread_t thread;
+	bool running = false;
+};
+
+#endif // !__LOADER_HEADER__
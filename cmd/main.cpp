@@ -1,56 +1,1235 @@
+#include "daemon.h"
+#include "decoder.h"
+#include "estimator.h"
+#include "loader.h"
+#include "merger.h"
+
+#include "aggregator.h"
+#include "basiclogreader.h"
+#include "collapser.h"
 #include "logreader.h"
+#include "offsets.h"
 
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-int main( int argc, const char * argv[] )
+static const char USAGE[] =
+	"usage: logreader [options] <filter> [<path>]\n"
+	"       logreader --merge [options] <filter> <path>...\n"
+	"       logreader --shards <n> <path>\n"
+	"       logreader --resolve <stream> [<path>]\n"
+	"       logreader --serve <socket>\n"
+	"       logreader --connect <socket> [options] <filter> <path>\n"
+	"reads the standard input if the path is '-' or omitted\n"
+	"gzip and zstd compressed files are decompressed on the fly\n"
+	"options:\n"
+	"  -i, --ignore-case   ASCII letters of the filter match regardless of their case\n"
+	"  -u, --utf8          a '?' of the filter matches a UTF-8 encoded character instead of a byte;\n"
+	"                      the filter is to be valid UTF-8\n"
+	"  -c, --count         print only the number of matching lines\n"
+	"  --estimate <frac>   estimate the number of matching lines from the given fraction of the file,\n"
+	"                      sampled in blocks spread over it, e.g. 0.01\n"
+	"  -n, --line-number   prefix every line with its number in the input, followed by ':' for\n"
+	"                      the matching lines and '-' for the context ones; numbered from the start of --range\n"
+	"  -B <n>              print n lines of leading context before every matching line\n"
+	"  -A <n>              print n lines of trailing context after every matching line\n"
+	"  -C <n>              print n lines of context around every matching line\n"
+	"  --max-line <n>      match and print only the first n bytes of a longer line, so an endless one takes\n"
+	"                      bounded memory; no limit by default\n"
+	"  --skip-long         pass over the lines longer than --max-line instead, they are still numbered\n"
+	"  -a, --text          read a binary file as text; a file having a NUL byte in its first block is skipped\n"
+	"  --expr              the filter is a boolean expression of wildcard filters combined with\n"
+	"                      '&', '|', '!' and parentheses, e.g. '*ERROR* & !*healthcheck*'\n"
+	"  --field <name>      match the filter against the value of the field instead of the whole line: a key\n"
+	"                      of the JSON object on the line or of its key=value pairs, 'name=' for the pairs only\n"
+	"  --offsets <path>    write the offsets, the lengths and with -n the numbers of the matching lines to the file\n"
+	"                      ('-' for the standard output) as a binary stream instead of the lines\n"
+	"  --resolve <stream>  print the lines of the file at the records of the stream, with their numbers if given\n"
+	"  --top <k>           print the k most frequent values captured by the '*' of the filter with their counts\n"
+	"  --group <list>      comma-separated numbers of the '*' making the value, starting from 1\n"
+	"                      (all but a leading one by default)\n"
+	"  --collapse          print every distinct matching line once, prefixed with its count, in the order of\n"
+	"                      the first appearance\n"
+	"  --adjacent          fold only the runs of equal adjacent lines instead, like uniq -c; with --collapse only\n"
+	"  --mask              take the lines differing only in the numbers, decimal or hexadecimal, as equal;\n"
+	"                      with --collapse only\n"
+	"  --limit <n>         maximum number of distinct values kept per thread (16384 by default), also of\n"
+	"                      the lines of --collapse\n"
+	"  --sketch            keep approximate counts of the most frequent values when the limit is reached\n"
+	"  --stats             print the time spent in every stage, the input volume and the worker utilization to stderr\n"
+	"  --trace <path>      write the spans of every block and worker in the Chrome trace format\n"
+	"  --profile <path>    load the number of the workers and the split of the blocks tuned for the host from\n"
+	"                      the profile, or save them there after tuning them over the first blocks\n"
+	"  --no-tune           split every block among the workers by its size only\n"
+	"  --merge             print the matching lines of all the files ordered by the timestamps at their beginnings\n"
+	"                      (ISO 8601, the common log format or syslog), a line without one follows the preceding\n"
+	"                      one of its file; the lines are prefixed with the paths of their files if there are several\n"
+	"  --range <off>:<len> process only the lines starting within the byte range, the length may be omitted\n"
+	"                      to read to the end; the outputs of adjacent ranges concatenate to the output of the whole,\n"
+	"                      unless numbered by -n: the lines are numbered from the first one of the range\n"
+	"  --shards <n>        print n balanced byte ranges of the file for --range\n"
+	"  --serve <socket>    run as a daemon answering the queries on the Unix socket, keeping the files mapped;\n"
+	"                      the queries of the same file are served by a single scan\n"
+	"  --connect <socket>  run the query by the daemon, it takes -i, -u, -c, -n, -A, -B, -C, --expr and --field\n"
+	"  --io <uring|pread>  read the file with several reads in flight using io_uring (default, where available)\n"
+	"                      or pread on a read-ahead thread\n"
+	"  --direct            read bypassing the page cache (O_DIRECT) where the file system supports it\n"
+	"  --affinity <policy> pin the workers to the CPUs: 'compact' fills the cores of a NUMA node first,\n"
+	"                      'scatter' spreads them over the nodes, or a list of CPUs like 0-3,8; the input\n"
+	"                      buffers are placed on the nodes of the workers processing them\n";
+
+struct Options
+{
+	const char* filter = nullptr;
+	const char* path = nullptr;
+	unsigned flags = 0; // Filter options
+	const char* field = nullptr;
+
+	size_t before = 0, after = 0; // context lines
+
+	LineLimit line; // of the length of the lines
+	bool text = false; // binary files are read too
+
+	const char* offsets = nullptr; // the path of the stream of the positions of the matching lines
+	const char* resolve = nullptr; // of the stream to print the lines of
+
+	bool count = false;
+	double estimate = 0; // the fraction to sample
+	bool numbers = false;
+
+	bool stats = false;
+	const char* trace = nullptr;
+
+	bool tune = true; // the split of the blocks
+	const char* profile = nullptr;
+
+	// the lines starting within the byte range
+	size_t offset = 0, length = SIZE_MAX;
+
+	size_t shards = 0;
+
+	// the files merged in the timestamp order
+	bool merge = false;
+	const char* const* paths = nullptr;
+	size_t files = 0;
+
+	Loader::Backend io = Loader::URING; // preferred
+	bool direct = false;
+
+	const char* affinity = nullptr; // policy
+
+	// folding the repeated lines
+	bool collapse = false;
+	bool adjacent = false;
+	bool mask = false;
+
+	size_t top = 0; // aggregation mode if not zero
+	uint32_t groups = 0;
+	size_t limit = Aggregator::LIMIT;
+	bool sketch = false;
+};
+
+static constexpr size_t PROBE = 64 * 1024; // looked up for a NUL byte
+
+// a file having a NUL byte near its beginning is taken as binary, like grep does, and is not read any further
+static bool Binary( const Sequence<char>& block, const Options& options )
+{
+	if( options.text || !memchr( block.from, 0, block.length() < PROBE ? block.length() : PROBE ) )
+	{
+		return false;
+	}
+
+	fprintf( stderr, "binary file %s skipped\n", options.path );
+	return true;
+}
+
+// feeds the decompressed content of the file to the reader piece by piece
+template< typename Reader >
+static bool Decompress( Reader& reader, const Options& options, Stats* stats )
+{
+	if( options.offset || options.length != SIZE_MAX )
+	{
+		fprintf( stderr, "cannot process a range of the compressed file %s\n", options.path );
+		return false;
+	}
+
+	Decoder decoder;
+	if( !decoder.Open( options.path ) )
+	{
+		fprintf( stderr, "cannot read the file %s: %s\n", options.path, decoder.error() );
+		return false;
+	}
+
+	char last = '\n';
+	bool first = true;
+
+	for( ;; )
+	{
+		Sequence<char> piece;
+		{
+			Stats::Span span( stats, Stats::READ );
+			piece = decoder.Next();
+			span.bytes = piece.length();
+		}
+
+		if( piece.empty() )
+		{
+			break;
+		}
+
+		if( first && Binary( piece, options ) )
+		{
+			return true;
+		}
+
+		first = false;
+		last = piece.to[-1];
+		if( !reader.AddSourceBlock( piece.from, piece.length() ) )
+		{
+			return true;
+		}
+	}
+
+	if( decoder.error() )
+	{
+		fprintf( stderr, "cannot decompress the file %s: %s\n", options.path, decoder.error() );
+		return false;
+	}
+
+	if( last != '\n' )
+	{
+		reader.AddSourceBlock( "\n", 1 );
+	}
+
+	return true;
+}
+
+// feeds the lines of the file starting within the range to the reader block by block
+// stores the offset in the file of the first byte passed to it if asked, before passing it
+template< typename Reader >
+static bool Read( Reader& reader, const Options& options, Stats* stats = nullptr, size_t* start = nullptr )
+{
+	Affinity affinity;
+	if( options.affinity )
+	{
+		if( !affinity.Parse( options.affinity ) )
+		{
+			fprintf( stderr, "invalid affinity or the CPUs are not available: %s\n", options.affinity );
+			return false;
+		}
+
+		reader.SetAffinity(&affinity);
+	}
+
+	const bool input = !strcmp( options.path, "-" ); // the standard input
+	if( !input && Decoder::Detect( options.path ) != Decoder::PLAIN )
+	{
+		return Decompress( reader, options, stats );
+	}
+
+	if( input && (options.offset || options.length != SIZE_MAX) )
+	{
+		fprintf( stderr, "cannot process a range of the standard input\n" );
+		return false;
+	}
+
+	if( !options.length )
+	{
+		return true;
+	}
+
+	// a line starts within the range if the preceding byte is a line break or the range starts at the beginning
+	size_t pos = options.offset ? options.offset - 1 : 0; // position of the block in the file
+	bool skipping = options.offset; // the line started before the range
+	bool done = false;
+
+	Loader loader( options.io, options.direct );
+	if( options.affinity )
+	{
+		loader.SetAffinity( &affinity, CLogReader::WORKERS );
+	}
+
+	if( input ? !loader.Open( STDIN_FILENO ) : !loader.Open( options.path, pos ) )
+	{
+		fprintf( stderr, "cannot open the file %s\n", options.path );
+		return false;
+	}
+
+	// the last byte of the range, the line containing it is read to the end
+	const size_t last = options.offset + options.length > options.offset ? options.offset + options.length - 1 : SIZE_MAX - 1;
+
+	char end = '\n'; // the last byte passed to the reader
+	bool first = true;
+
+	while( !done )
+	{
+		Sequence<char> block;
+		{
+			Stats::Span span( stats, Stats::READ );
+			block = loader.Next();
+			span.bytes = block.length();
+		}
+
+		if( block.empty() )
+		{
+			break;
+		}
+
+		if( first && Binary( block, options ) )
+		{
+			return true;
+		}
+
+		first = false;
+
+		const auto sz = block.length();
+		auto from = block.from, to = block.to;
+
+		if( skipping )
+		{
+			auto ln = static_cast< const char* >( memchr( from, '\n', sz ) );
+			skipping = !ln;
+			from = ln ? ln+1 : to;
+
+			if( !skipping && pos + (from - block.from) > last )
+			{
+				to = from; // no line starts within the range
+				done = true;
+			}
+		}
+
+		if( !done && last < pos + sz )
+		{
+			const auto p = pos + (from - block.from) > last ? from : block.from + (last - pos);
+			if( auto ln = static_cast< const char* >( memchr( p, '\n', to - p ) ) )
+			{
+				to = ln+1;
+				done = true;
+			}
+		}
+
+		if( start && from != to )
+		{
+			*start = pos + (from - block.from);
+			start = nullptr;
+		}
+
+		pos += sz;
+
+		if( from != to )
+		{
+			end = to[-1];
+			if( !reader.AddSourceBlock( from, to - from ) )
+			{
+				return true;
+			}
+		}
+	}
+
+	if( loader.error() )
+	{
+		fprintf( stderr, "cannot read the file %s: %s\n", options.path, loader.error() );
+		return false;
+	}
+
+	// complete the last line
+	if( end != '\n' )
+	{
+		reader.AddSourceBlock( "\n", 1 );
+	}
+
+	return true;
+}
+
+// tunes the split of the blocks of the reader unless disabled, as in the profile if it has the host
+template< typename Reader >
+static void Tune( Reader& reader, Tuner& tuner, const Options& options )
+{
+	if( options.tune )
+	{
+		if( options.profile )
+		{
+			tuner.Load( options.profile );
+		}
+
+		reader.SetTuner(&tuner);
+	}
+}
+
+static bool SaveProfile( const Tuner& tuner, const Options& options )
+{
+	if( options.tune && options.profile && tuner.settled() && !tuner.Save( options.profile ) )
+	{
+		fprintf( stderr, "cannot save the profile %s\n", options.profile );
+		return false;
+	}
+
+	return true;
+}
+
+// prints n ranges of about equal size covering the file
+static int Shard( const Options& options )
+{
+	FILE* file = fopen( options.path, "r" );
+	if( !file || fseeko( file, 0, SEEK_END ) )
+	{
+		fprintf( stderr, "cannot open the file %s\n", options.path );
+		return 1;
+	}
+
+	const size_t size = ftello(file);
+	fclose(file);
+
+	for( size_t i = 0; i < options.shards; ++i )
+	{
+		const auto from = size / options.shards * i + size % options.shards * i / options.shards;
+		const auto to = size / options.shards * (i+1) + size % options.shards * (i+1) / options.shards;
+
+		printf( "%zu:%zu\n", from, to - from );
+	}
+
+	return 0;
+}
+
+static int Print( const Options& options )
 {
-	if( argc != 3 )
+	CLogReader::Printer printer;
+	printer.numbers = options.numbers;
+
+	CLogReader reader(&printer);
+	if( !reader.SetFilter( options.filter, options.flags ) )
+	{
+		fprintf( stderr, "invalid filter: %s\n", options.filter );
+		return 1;
+	}
+
+	if( !reader.SetField( options.field ) )
+	{
+		fprintf( stderr, "invalid field: %s\n", options.field );
+		return 1;
+	}
+
+	reader.SetContext( options.before, options.after );
+	reader.SetLimit( options.line );
+
+	Tuner tuner( CLogReader::WORKERS, CLogReader::BLOCK );
+	Tune( reader, tuner, options );
+
+	if( !options.stats && !options.trace )
+	{
+		return Read( reader, options ) && SaveProfile( tuner, options ) ? 0 : 1;
+	}
+
+	Stats stats( options.trace );
+	reader.SetStats(&stats);
+
+	if( !Read( reader, options, &stats ) )
+	{
+		return 1;
+	}
+
+	fflush(stdout);
+
+	if( options.stats )
+	{
+		stats.Print(stderr);
+		if( options.tune )
+		{
+			tuner.Print(stderr);
+		}
+	}
+
+	if( !SaveProfile( tuner, options ) )
 	{
-		printf( "usage: logreader <filter> <path>\n" );
 		return 1;
 	}
 
-	const char* filter = argv[1];
-	const char* path = argv[2];
+	if( options.trace )
+	{
+		FILE* file = fopen( options.trace, "w" );
+		if( !file )
+		{
+			fprintf( stderr, "cannot open the file %s\n", options.trace );
+			return 1;
+		}
+
+		stats.WriteTrace(file);
+		fclose(file);
+	}
+
+	return 0;
+}
+
+// writes the positions of the matching lines instead of the lines
+struct Locator : CLogReader::Handler
+{
+	Locator( FILE* file, bool numbers ) : writer( file, numbers ) {}
+
+	void Handle( const Sequence<Line>& lines ) override
+	{
+		for( const auto& line : lines )
+		{
+			writer.Write( base + reader->offset(line), line.length(), line.number );
+		}
+	}
+
+	const CLogReader* reader = nullptr;
+	size_t base = 0; // offset of the input in the file
+
+	Offsets::Writer writer;
+};
+
+static int Locate( const Options& options )
+{
+	const bool output = !strcmp( options.offsets, "-" );
 
-	CLogReader reader;
-	if( !reader.SetFilter(filter) )
+	FILE* file = output ? stdout : fopen( options.offsets, "wb" );
+	if( !file )
 	{
-		printf( "invalid filter: %s", filter );
+		fprintf( stderr, "cannot open the file %s\n", options.offsets );
 		return 1;
 	}
 
-	if( FILE* file = fopen( path, "r" ) )
+	int status = 1;
 	{
-		const size_t BUF = 10*1024*1024;
-		char* buf = new char[BUF+1];
+		Locator locator( file, options.numbers );
+
+		CLogReader reader(&locator);
+		locator.reader = &reader;
 
-		while( !feof(file) )
+		if( !reader.SetFilter( options.filter, options.flags ) )
+		{
+			fprintf( stderr, "invalid filter: %s\n", options.filter );
+		}
+		else if( !reader.SetField( options.field ) )
 		{
-			auto sz = fread( buf, 1, BUF, file );
-			if( sz > 0 )
+			fprintf( stderr, "invalid field: %s\n", options.field );
+		}
+		else
+		{
+			reader.SetLimit( options.line );
+
+			Tuner tuner( CLogReader::WORKERS, CLogReader::BLOCK );
+			Tune( reader, tuner, options );
+
+			if( Read( reader, options, nullptr, &locator.base ) && SaveProfile( tuner, options ) )
 			{
-				if( feof(file) && buf[ sz-1 ] != '\n' )
-				{
-					buf[sz++] = '\n';
-				}
-
-				if( !reader.AddSourceBlock( buf, sz ) )
-				{
-					break;
-				}
+				status = 0;
 			}
 		}
 
-		delete[] buf;
+		if( !locator.writer.Flush() )
+		{
+			fprintf( stderr, "cannot write the file %s\n", options.offsets );
+			status = 1;
+		}
+	}
 
+	if( !output )
+	{
 		fclose(file);
 	}
-	else
+
+	return status;
+}
+
+// prints the lines at the records of a stream of the offsets, reading the file once in order
+struct Resolver
+{
+	explicit Resolver( FILE* stream ) : records(stream) {}
+
+	void SetAffinity( const Affinity* ) {} // no workers
+
+	bool AddSourceBlock( const char* block, const size_t size )
+	{
+		const auto end = position + size;
+		while( pending && record.offset + written < end )
+		{
+			const auto from = record.offset + written;
+			if( from < position )
+			{
+				pending = false; // the records went back, the stream is not of the file
+				break;
+			}
+
+			if( !written && records.numbers() )
+			{
+				printf( "%llu:", static_cast< unsigned long long >( record.number ) );
+			}
+
+			const auto to = record.offset + record.length < end ? record.offset + record.length : end;
+			fwrite( block + (from - position), 1, to - from, stdout );
+			written += to - from;
+
+			if( written < record.length )
+			{
+				break;
+			}
+
+			putchar('\n');
+			written = 0;
+			pending = records.Next(record);
+		}
+
+		position = end;
+		return pending;
+	}
+
+	Offsets::Reader records;
+	Offsets::Record record;
+	bool pending = false; // the record is not printed completely
+
+	uint64_t position = 0; // of the block in the file
+	uint64_t written = 0; // of the record
+};
+
+static int Resolve( const Options& options )
+{
+	const bool input = !strcmp( options.resolve, "-" );
+	if( input && !strcmp( options.path, "-" ) )
 	{
-		printf( "cannot open the file %s\n", path );
+		fprintf( stderr, "cannot read both the stream and the file from the standard input\n" );
 		return 1;
 	}
 
-	return 0;
+	FILE* file = input ? stdin : fopen( options.resolve, "rb" );
+	if( !file )
+	{
+		fprintf( stderr, "cannot open the file %s\n", options.resolve );
+		return 1;
+	}
+
+	Resolver resolver(file);
+
+	auto opts = options;
+	opts.text = true; // the lines are where the stream says
+
+	bool done = resolver.records.Open();
+	if( done && (resolver.pending = resolver.records.Next( resolver.record )) )
+	{
+		done = Read( resolver, opts ) && !resolver.pending;
+	}
+
+	fflush(stdout);
+
+	if( resolver.records.error() )
+	{
+		fprintf( stderr, "cannot read the stream %s: %s\n", options.resolve, resolver.records.error() );
+	}
+	else if( !done )
+	{
+		fprintf( stderr, "the stream %s does not fit the file %s\n", options.resolve, options.path );
+	}
+
+	if( !input )
+	{
+		fclose(file);
+	}
+
+	return done && !resolver.records.error() ? 0 : 1;
+}
+
+struct Counter
+{
+	void Handle( const Sequence<char>& ) { ++total; }
+	void Merge( Counter& other ) { total += other.total; other.total = 0; }
+
+	size_t total = 0;
+};
+
+static int Count( const Options& options )
+{
+	BasicLogReader< Counter, ExpressionMatcher > reader;
+	if( !reader.SetFilter( options.filter, options.flags ) )
+	{
+		fprintf( stderr, "invalid filter: %s\n", options.filter );
+		return 1;
+	}
+
+	if( !reader.SetField( options.field ) )
+	{
+		fprintf( stderr, "invalid field: %s\n", options.field );
+		return 1;
+	}
+
+	reader.SetLimit( options.line );
+
+	Tuner tuner( CLogReader::WORKERS, CLogReader::BLOCK );
+	Tune( reader, tuner, options );
+
+	if( !Read( reader, options ) )
+	{
+		return 1;
+	}
+
+	printf( "%zu\n", reader.handler().total );
+	return SaveProfile( tuner, options ) ? 0 : 1;
+}
+
+static int Estimate( const Options& options )
+{
+	if( !strcmp( options.path, "-" ) || Decoder::Detect( options.path ) != Decoder::PLAIN || options.offset || options.length != SIZE_MAX )
+	{
+		fprintf( stderr, "the estimate needs a whole uncompressed file\n" );
+		return 1;
+	}
+
+	ExpressionMatcher matcher;
+	if( !matcher.Set( options.filter, options.flags ) )
+	{
+		fprintf( stderr, "invalid filter: %s\n", options.filter );
+		return 1;
+	}
+
+	if( !matcher.SetField( options.field ) )
+	{
+		fprintf( stderr, "invalid field: %s\n", options.field );
+		return 1;
+	}
+
+	Estimator estimator( matcher, options.line );
+	Estimator::Result result;
+
+	const auto started = Stats::Wall();
+	if( !estimator.Run( options.path, options.estimate, result ) )
+	{
+		fprintf( stderr, "cannot read the file %s: %s\n", options.path, estimator.error() );
+		return 1;
+	}
+
+	if( result.exact )
+	{
+		printf( "%.0f matching lines of %.0f (the whole file was read)\n", result.matches, result.lines );
+	}
+	else if( result.blocks == 1 )
+	{
+		printf( "~%.0f matching lines of ~%.0f, no confidence interval from a single block\n", result.matches, result.lines );
+	}
+	else
+	{
+		const auto low = result.matches > result.margin ? result.matches - result.margin : 0;
+		printf( "~%.0f matching lines, 95%% confidence interval %.0f - %.0f, of ~%.0f lines\n",
+			result.matches, low, result.matches + result.margin, result.lines );
+	}
+
+	printf( "blocks sampled: %zu, %zu of %zu bytes read (%.3f%%) in %.3f s\n", result.blocks, result.read, result.size,
+		result.size ? 100.0 * result.read / result.size : 0.0, Stats::Wall() - started );
+
+	return 0;
+}
+
+static int Aggregate( const Options& options )
+{
+	if( options.flags & Filter::EXPRESSION )
+	{
+		fprintf( stderr, "cannot capture from a filter expression\n" );
+		return 1;
+	}
+
+	WildcardMatcher matcher;
+	if( !matcher.Set( options.filter, options.flags ) )
+	{
+		fprintf( stderr, "invalid filter: %s\n", options.filter );
+		return 1;
+	}
+
+	const auto captures = matcher.captures();
+	if( !captures )
+	{
+		fprintf( stderr, "the filter has no '*' to capture: %s\n", options.filter );
+		return 1;
+	}
+
+	auto groups = options.groups;
+	if( !groups )
+	{
+		// all the captures but the leading one, which is usually just an unanchored beginning
+		groups = (1u << captures) - 1;
+		if( options.filter[0] == '*' && captures > 1 )
+		{
+			groups &= ~1u;
+		}
+	}
+	else if( groups >> captures )
+	{
+		fprintf( stderr, "the filter has only %zu '*' to capture\n", captures );
+		return 1;
+	}
+
+	BasicLogReader< Aggregator > reader( groups, options.limit, options.sketch );
+	reader.SetFilter( options.filter, options.flags );
+	reader.SetLimit( options.line );
+
+	if( !Read( reader, options ) )
+	{
+		return 1;
+	}
+
+	const auto& aggregator = reader.handler();
+
+	auto top = new const Aggregator::Entry*[ options.top ];
+	const auto n = aggregator.Top( top, options.top );
+
+	for( size_t i = 0; i < n; ++i )
+	{
+		const auto key = aggregator.key( *top[i] );
+		printf( "%zu\t%.*s\n", top[i]->count, int( key.length() ), key.from );
+	}
+
+	delete[] top;
+
+	if( aggregator.dropped )
+	{
+		fprintf( stderr, "%zu matching lines not counted: too many distinct values, consider --limit or --sketch\n", aggregator.dropped );
+	}
+
+	if( aggregator.error )
+	{
+		fprintf( stderr, "the counts may be underestimated by up to %zu\n", aggregator.error );
+	}
+
+	return 0;
+}
+
+static int Collapse( const Options& options )
+{
+	BasicLogReader< Collapser, ExpressionMatcher > reader( stdout, options.adjacent, options.mask, options.limit );
+	if( !reader.SetFilter( options.filter, options.flags ) )
+	{
+		fprintf( stderr, "invalid filter: %s\n", options.filter );
+		return 1;
+	}
+
+	if( !reader.SetField( options.field ) )
+	{
+		fprintf( stderr, "invalid field: %s\n", options.field );
+		return 1;
+	}
+
+	reader.SetLimit( options.line );
+
+	Tuner tuner( CLogReader::WORKERS, CLogReader::BLOCK );
+	Tune( reader, tuner, options );
+
+	if( !Read( reader, options ) )
+	{
+		return 1;
+	}
+
+	auto& collapser = reader.handler();
+	collapser.Finish();
+
+	if( collapser.dropped )
+	{
+		fflush(stdout);
+		fprintf( stderr, "%zu matching lines not printed: too many distinct lines, consider --limit or --adjacent\n", collapser.dropped );
+	}
+
+	return SaveProfile( tuner, options ) ? 0 : 1;
+}
+
+static int Merge( const Options& options )
+{
+	Merger merger( options.paths, options.files, options.io, options.direct );
+	merger.labels = options.files > 1;
+	merger.numbers = options.numbers;
+
+	if( !merger.SetFilter( options.filter, options.flags ) )
+	{
+		fprintf( stderr, "invalid filter: %s\n", options.filter );
+		return 1;
+	}
+
+	if( !merger.SetField( options.field ) )
+	{
+		fprintf( stderr, "invalid field: %s\n", options.field );
+		return 1;
+	}
+
+	merger.SetLimit( options.line );
+
+	if( !merger.Run(stdout) )
+	{
+		fflush(stdout);
+		fprintf( stderr, "cannot read the file %s: %s\n", merger.path(), merger.error() );
+		return 1;
+	}
+
+	return 0;
+}
+
+static int Serve( const char* socket )
+{
+	Daemon daemon;
+	if( !daemon.Listen(socket) )
+	{
+		fprintf( stderr, "cannot serve on %s: %s\n", socket, daemon.error() );
+		return 1;
+	}
+
+	daemon.Run();
+
+	fprintf( stderr, "cannot serve on %s: %s\n", socket, daemon.error() );
+	return 1;
+}
+
+// passes the query to the daemon, with the path of the file made absolute
+static int Connect( const char* socket, int argc, const char* argv[] )
+{
+	char path[PATH_MAX];
+	const char* file = argv[ argc-1 ];
+
+	if( file[0] != '/' )
+	{
+		// or relative to the current directory if it does not exist, for the error message
+		char cwd[PATH_MAX];
+		if( realpath( file, path ) || (getcwd( cwd, sizeof(cwd) ) && snprintf( path, sizeof(path), "%s/%s", cwd, file ) < int( sizeof(path) )) )
+		{
+			argv[ argc-1 ] = path;
+		}
+	}
+
+	const auto status = Daemon::Request( socket, argv, argc, stdout, stdout );
+	if( status < 0 )
+	{
+		fflush(stdout);
+		fprintf( stderr, "cannot query the daemon on %s\n", socket );
+		return 1;
+	}
+
+	return status;
+}
+
+static bool ParseCount( const char* text, size_t& count )
+{
+	char* end;
+	count = strtoull( text, &end, 10 );
+
+	return end != text && !*end;
+}
+
+static bool ParseFraction( const char* text, double& fraction )
+{
+	char* end;
+	fraction = strtod( text, &end );
+
+	return end != text && !*end && fraction > 0 && fraction <= 1;
+}
+
+// parses <offset>:<length> or <offset>: meaning the rest of the file
+static bool ParseRange( const char* text, size_t& offset, size_t& length )
+{
+	char* end;
+	offset = strtoull( text, &end, 10 );
+	if( end == text || *end != ':' )
+	{
+		return false;
+	}
+
+	length = SIZE_MAX;
+	return !end[1] || ParseCount( end+1, length );
+}
+
+// parses a comma-separated list of 1-based capture numbers into a bit mask
+static bool ParseGroups( const char* list, uint32_t& groups )
+{
+	groups = 0;
+	for( auto p = list; *p; )
+	{
+		char* end;
+		auto n = strtoul( p, &end, 10 );
+		if( end == p || n < 1 || n > WildcardMatcher::CAPTURES || (*end && *end != ',') )
+		{
+			return false;
+		}
+
+		groups |= 1u << (n-1);
+		p = *end ? end+1 : end;
+	}
+
+	return groups;
+}
+
+int main( int argc, const char * argv[] )
+{
+	Options options;
+
+	if( argc == 3 && !strcmp( argv[1], "--serve" ) )
+	{
+		return Serve( argv[2] );
+	}
+
+	if( argc > 3 && !strcmp( argv[1], "--connect" ) )
+	{
+		return Connect( argv[2], argc - 3, argv + 3 );
+	}
+
+	int i = 1;
+	for( ; i < argc && argv[i][0] == '-' && argv[i][1]; ++i )
+	{
+		const char* option = argv[i];
+		const char* value = i+1 < argc ? argv[i+1] : nullptr;
+
+		if( !strcmp( option, "--" ) )
+		{
+			++i;
+			break;
+		}
+		else if( !strcmp( option, "-i" ) || !strcmp( option, "--ignore-case" ) )
+		{
+			options.flags |= Filter::ICASE;
+		}
+		else if( !strcmp( option, "-u" ) || !strcmp( option, "--utf8" ) )
+		{
+			options.flags |= Filter::UTF8;
+		}
+		else if( !strcmp( option, "-c" ) || !strcmp( option, "--count" ) )
+		{
+			options.count = true;
+		}
+		else if( !strcmp( option, "-n" ) || !strcmp( option, "--line-number" ) )
+		{
+			options.numbers = true;
+		}
+		else if( !strcmp( option, "--estimate" ) && value && ParseFraction( value, options.estimate ) )
+		{
+			++i;
+		}
+		else if( !strcmp( option, "-B" ) && value && ParseCount( value, options.before ) )
+		{
+			++i;
+		}
+		else if( !strcmp( option, "-A" ) && value && ParseCount( value, options.after ) )
+		{
+			++i;
+		}
+		else if( !strcmp( option, "-C" ) && value && ParseCount( value, options.before ) )
+		{
+			options.after = options.before;
+			++i;
+		}
+		else if( !strcmp( option, "--max-line" ) && value && ParseCount( value, options.line.length ) && options.line.length )
+		{
+			++i;
+		}
+		else if( !strcmp( option, "--skip-long" ) )
+		{
+			options.line.policy = LineLimit::SKIP;
+		}
+		else if( !strcmp( option, "-a" ) || !strcmp( option, "--text" ) )
+		{
+			options.text = true;
+		}
+		else if( !strcmp( option, "--expr" ) )
+		{
+			options.flags |= Filter::EXPRESSION;
+		}
+		else if( !strcmp( option, "--field" ) && value )
+		{
+			options.field = value;
+			++i;
+		}
+		else if( !strcmp( option, "--offsets" ) && value )
+		{
+			options.offsets = value;
+			++i;
+		}
+		else if( !strcmp( option, "--resolve" ) && value )
+		{
+			options.resolve = value;
+			++i;
+		}
+		else if( !strcmp( option, "--top" ) && value && (options.top = strtoull( value, nullptr, 10 )) )
+		{
+			++i;
+		}
+		else if( !strcmp( option, "--group" ) && value && ParseGroups( value, options.groups ) )
+		{
+			++i;
+		}
+		else if( !strcmp( option, "--limit" ) && value && (options.limit = strtoull( value, nullptr, 10 )) )
+		{
+			++i;
+		}
+		else if( !strcmp( option, "--collapse" ) )
+		{
+			options.collapse = true;
+		}
+		else if( !strcmp( option, "--adjacent" ) )
+		{
+			options.adjacent = true;
+		}
+		else if( !strcmp( option, "--mask" ) )
+		{
+			options.mask = true;
+		}
+		else if( !strcmp( option, "--sketch" ) )
+		{
+			options.sketch = true;
+		}
+		else if( !strcmp( option, "--stats" ) )
+		{
+			options.stats = true;
+		}
+		else if( !strcmp( option, "--trace" ) && value )
+		{
+			options.trace = value;
+			++i;
+		}
+		else if( !strcmp( option, "--merge" ) )
+		{
+			options.merge = true;
+		}
+		else if( !strcmp( option, "--profile" ) && value )
+		{
+			options.profile = value;
+			++i;
+		}
+		else if( !strcmp( option, "--no-tune" ) )
+		{
+			options.tune = false;
+		}
+		else if( !strcmp( option, "--range" ) && value && ParseRange( value, options.offset, options.length ) )
+		{
+			++i;
+		}
+		else if( !strcmp( option, "--io" ) && value && (!strcmp( value, "uring" ) || !strcmp( value, "pread" )) )
+		{
+			options.io = strcmp( value, "uring" ) ? Loader::PREAD : Loader::URING;
+			++i;
+		}
+		else if( !strcmp( option, "--direct" ) )
+		{
+			options.direct = true;
+		}
+		else if( !strcmp( option, "--affinity" ) && value )
+		{
+			options.affinity = value;
+			++i;
+		}
+		else if( !strcmp( option, "--shards" ) && value && ParseCount( value, options.shards ) && options.shards )
+		{
+			++i;
+		}
+		else
+		{
+			fprintf( stderr, "invalid option: %s\n%s", option, USAGE );
+			return 1;
+		}
+	}
+
+	if( (options.adjacent || options.mask) && !options.collapse )
+	{
+		fprintf( stderr, "--adjacent and --mask apply only to --collapse\n" );
+		return 1;
+	}
+
+	if( options.shards )
+	{
+		if( argc - i != 1 )
+		{
+			printf( "%s", USAGE );
+			return 1;
+		}
+
+		options.path = argv[i];
+		return Shard(options);
+	}
+
+	if( options.resolve )
+	{
+		if( argc - i > 1 )
+		{
+			printf( "%s", USAGE );
+			return 1;
+		}
+
+		options.path = argc - i == 1 ? argv[i] : "-";
+		return Resolve(options);
+	}
+
+	if( options.merge )
+	{
+		if( argc - i < 2 )
+		{
+			printf( "%s", USAGE );
+			return 1;
+		}
+
+		if( options.count || options.estimate || options.top || options.before || options.after || options.stats || options.trace ||
+			options.offset || options.length != SIZE_MAX || options.affinity || options.offsets ||
+			options.collapse )
+		{
+			fprintf( stderr, "--merge does not apply to --count, --estimate, --top, the context, --stats, --trace, --range, --affinity,\n"
+				"--offsets and --collapse\n" );
+			return 1;
+		}
+
+		options.filter = argv[i];
+		options.paths = argv + i+1;
+		options.files = argc - i-1;
+
+		return Merge(options);
+	}
+
+	if( argc - i != 1 && argc - i != 2 )
+	{
+		printf( "%s", USAGE );
+		return 1;
+	}
+
+	options.filter = argv[i];
+	options.path = argc - i == 2 ? argv[i+1] : "-";
+
+	if( (options.stats || options.trace) && (options.top || options.count) )
+	{
+		fprintf( stderr, "--stats and --trace apply only to printing the matching lines\n" );
+		return 1;
+	}
+
+	if( options.collapse && (options.count || options.estimate || options.top || options.numbers || options.before || options.after ||
+		options.stats || options.trace || options.offsets) )
+	{
+		fprintf( stderr, "--collapse does not apply to --count, --estimate, --top, -n, the context, --stats, --trace\n"
+			"and --offsets\n" );
+		return 1;
+	}
+
+	if( options.collapse )
+	{
+		return Collapse(options);
+	}
+
+	if( options.offsets && (options.count || options.estimate || options.top || options.before || options.after ||
+		options.stats || options.trace) )
+	{
+		fprintf( stderr, "--offsets does not apply to --count, --estimate, --top, the context, --stats and --trace\n" );
+		return 1;
+	}
+
+	if( options.offsets )
+	{
+		return Locate(options);
+	}
+
+	if( options.field && options.top )
+	{
+		fprintf( stderr, "--field does not apply to --top\n" );
+		return 1;
+	}
+
+	if( options.estimate )
+	{
+		return Estimate(options);
+	}
+
+	if( options.top )
+	{
+		return Aggregate(options);
+	}
+
+	return options.count ? Count(options) : Print(options);
 }
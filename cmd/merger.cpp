@@ -0,0 +1,442 @@
+#include "merger.h"
+
+#include <string.h>
+#include <unistd.h>
+
+static constexpr int64_t SECOND = 1000000000;
+
+static const char MONTHS[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+// parses exactly n digits
+static bool Digits( const char*& p, const char* end, size_t n, int& value )
+{
+	if( size_t( end - p ) < n )
+	{
+		return false;
+	}
+
+	value = 0;
+	for( size_t i = 0; i < n; ++i, ++p )
+	{
+		if( *p < '0' || *p > '9' )
+		{
+			return false;
+		}
+
+		value = value * 10 + (*p - '0');
+	}
+
+	return true;
+}
+
+// parses the abbreviated English name of a month, 1 to 12
+static bool Month( const char*& p, const char* end, int& month )
+{
+	if( end - p < 3 )
+	{
+		return false;
+	}
+
+	for( month = 0; month < 12; ++month )
+	{
+		if( !memcmp( p, MONTHS + 3 * month, 3 ) )
+		{
+			p += 3;
+			++month;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// parses hh:mm:ss with an optional fraction of a second
+static bool Time( const char*& p, const char* end, int64_t& time )
+{
+	int hour, minute, second;
+	if( !Digits( p, end, 2, hour ) || p == end || *p++ != ':' || !Digits( p, end, 2, minute ) ||
+		p == end || *p++ != ':' || !Digits( p, end, 2, second ) || hour > 23 || minute > 59 || second > 60 )
+	{
+		return false;
+	}
+
+	time = ((hour * 60 + minute) * 60 + second) * SECOND;
+
+	if( end - p > 1 && (*p == '.' || *p == ',') && p[1] >= '0' && p[1] <= '9' )
+	{
+		int64_t scale = SECOND;
+		for( ++p; p != end && *p >= '0' && *p <= '9'; ++p )
+		{
+			scale /= 10; // the digits beyond the nanoseconds are ignored
+			time += (*p - '0') * scale;
+		}
+	}
+
+	return true;
+}
+
+// parses the zone as Z or +hh[[:]mm], returns its offset from UTC or 0 if there is none
+static int64_t Zone( const char*& p, const char* end )
+{
+	if( p != end && *p == 'Z' )
+	{
+		++p;
+		return 0;
+	}
+
+	auto q = p;
+	if( q != end && *q == ' ' )
+	{
+		++q;
+	}
+
+	int hours, minutes = 0;
+	if( q == end || (*q != '+' && *q != '-') )
+	{
+		return 0;
+	}
+
+	const auto sign = *q++ == '-' ? -1 : 1;
+	if( !Digits( q, end, 2, hours ) )
+	{
+		return 0;
+	}
+
+	auto r = q;
+	if( r != end && *r == ':' )
+	{
+		++r;
+	}
+
+	if( Digits( r, end, 2, minutes ) )
+	{
+		q = r;
+	}
+
+	p = q;
+	return sign * (hours * 60 + minutes) * 60 * SECOND;
+}
+
+// the number of the days since the epoch of a date of the proleptic Gregorian calendar
+static int64_t Days( int year, int month, int day )
+{
+	year -= month <= 2;
+
+	const int64_t era = (year >= 0 ? year : year - 399) / 400;
+	const int64_t yoe = year - era * 400;
+	const int64_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	const int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+	return era * 146097 + doe - 719468;
+}
+
+bool Merger::Timestamp( const Sequence<char>& line, int64_t& time )
+{
+	auto p = line.from;
+	const auto end = line.to;
+
+	if( p != end && (*p == '[' || *p == '(' || *p == '"' || *p == '\'') )
+	{
+		++p;
+	}
+
+	int year, month, day;
+	int64_t clock;
+
+	if( end - p > 4 && p[0] >= '0' && p[0] <= '9' && p[4] == '-' )
+	{
+		// 2026-10-19T12:34:56
+		if( !Digits( p, end, 4, year ) || p == end || *p++ != '-' || !Digits( p, end, 2, month ) ||
+			p == end || *p++ != '-' || !Digits( p, end, 2, day ) || p == end || (*p != 'T' && *p != ' ') ||
+			!Time( ++p, end, clock ) )
+		{
+			return false;
+		}
+	}
+	else if( end - p >= 3 && p[0] >= '0' && p[0] <= '9' && p[2] == '/' )
+	{
+		// 19/Oct/2026:12:34:56
+		if( !Digits( p, end, 2, day ) || p == end || *p++ != '/' || !Month( p, end, month ) || p == end || *p++ != '/' ||
+			!Digits( p, end, 4, year ) || p == end || *p != ':' || !Time( ++p, end, clock ) )
+		{
+			return false;
+		}
+	}
+	else if( Month( p, end, month ) )
+	{
+		// Oct 19 12:34:56, the day is padded with a space
+		if( end - p < 3 || *p++ != ' ' )
+		{
+			return false;
+		}
+
+		if( *p == ' ' )
+		{
+			++p;
+		}
+
+		const auto from = p;
+		for( day = 0; p != end && p - from < 2 && *p >= '0' && *p <= '9'; ++p )
+		{
+			day = day * 10 + (*p - '0');
+		}
+
+		if( p == from || p == end || *p != ' ' || !Time( ++p, end, clock ) )
+		{
+			return false;
+		}
+
+		year = 1970;
+	}
+	else
+	{
+		return false;
+	}
+
+	// within the range of the nanoseconds since the epoch
+	if( year < 1678 || year > 2261 || month < 1 || month > 12 || day < 1 || day > 31 )
+	{
+		return false;
+	}
+
+	time = Days( year, month, day ) * 86400 * SECOND + clock - Zone( p, end );
+	return true;
+}
+
+Merger::Merger( const char* const* paths, size_t n, Loader::Backend backend, bool drct ) :
+	count(n), io(backend), direct(drct)
+{
+	sources = new Source[count];
+	heap = new size_t[count];
+
+	for( size_t i = 0; i < count; ++i )
+	{
+		auto& source = sources[i];
+		source.path = paths[i];
+		source.label = strcmp( paths[i], "-" ) ? paths[i] : "(standard input)";
+	}
+}
+
+Merger::~Merger()
+{
+	delete[] heap;
+	delete[] sources;
+}
+
+bool Merger::SetFilter( const char* filter, unsigned options )
+{
+	for( size_t i = 0; i < count; ++i )
+	{
+		if( !sources[i].reader.SetFilter( filter, options ) )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool Merger::SetField( const char* field )
+{
+	for( size_t i = 0; i < count; ++i )
+	{
+		if( !sources[i].reader.SetField(field) )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void Merger::SetLimit( const LineLimit& limit )
+{
+	for( size_t i = 0; i < count; ++i )
+	{
+		sources[i].reader.SetLimit(limit);
+	}
+}
+
+bool Merger::Run( FILE* file )
+{
+	size = 0;
+	for( size_t i = 0; i < count; ++i )
+	{
+		auto& source = sources[i];
+		if( !source.Open( io, direct ) || (!source.Fill() && source.failure) )
+		{
+			failure = source.failure;
+			failed = source.path;
+
+			return false;
+		}
+
+		if( !source.entries.empty() )
+		{
+			heap[ size++ ] = i;
+		}
+	}
+
+	for( auto i = size / 2; i--; )
+	{
+		Down(i);
+	}
+
+	while(size)
+	{
+		auto& source = sources[ heap[0] ];
+
+		const auto& entry = source.head();
+		const auto line = source.line(entry);
+
+		if(labels)
+		{
+			fputs( source.label, file );
+			fputc( ':', file );
+		}
+
+		if(numbers)
+		{
+			fprintf( file, "%zu:", entry.number );
+		}
+
+		fwrite( line.from, 1, line.length(), file );
+		fputc( '\n', file );
+
+		if( ++source.next == source.entries.size() && !source.Fill() )
+		{
+			if( source.failure )
+			{
+				failure = source.failure;
+				failed = source.path;
+
+				return false;
+			}
+
+			heap[0] = heap[ --size ]; // the file ended
+		}
+
+		Down(0);
+	}
+
+	return true;
+}
+
+bool Merger::Less( size_t a, size_t b ) const
+{
+	const auto ta = sources[a].entries.data()[ sources[a].next ].time;
+	const auto tb = sources[b].entries.data()[ sources[b].next ].time;
+
+	return ta != tb ? ta < tb : a < b;
+}
+
+void Merger::Down( size_t i )
+{
+	for( ;; )
+	{
+		auto least = i;
+		const auto left = 2 * i + 1, right = left + 1;
+
+		if( left < size && Less( heap[left], heap[least] ) )
+		{
+			least = left;
+		}
+
+		if( right < size && Less( heap[right], heap[least] ) )
+		{
+			least = right;
+		}
+
+		if( least == i )
+		{
+			return;
+		}
+
+		const auto item = heap[i];
+		heap[i] = heap[least];
+		heap[least] = item;
+
+		i = least;
+	}
+}
+
+Merger::Source::Source() : reader(this)
+{
+}
+
+Merger::Source::~Source()
+{
+	delete loader;
+	delete decoder;
+}
+
+void Merger::Source::Handle( const Sequence<Line>& lines )
+{
+	for( const auto& line : lines )
+	{
+		int64_t stamp;
+		if( Timestamp( line, stamp ) )
+		{
+			time = stamp;
+		}
+
+		entries.Append( Entry{ text.size(), line.length(), line.number, time } );
+		text.Append(line);
+	}
+}
+
+bool Merger::Source::Open( Loader::Backend io, bool direct )
+{
+	const bool input = !strcmp( path, "-" );
+	if( !input && Decoder::Detect(path) != Decoder::PLAIN )
+	{
+		decoder = new Decoder;
+		if( !decoder->Open(path) )
+		{
+			failure = decoder->error();
+			return false;
+		}
+
+		return true;
+	}
+
+	loader = new Loader( io, direct );
+	if( input ? !loader->Open( STDIN_FILENO ) : !loader->Open(path) )
+	{
+		failure = loader->error() ? loader->error() : "cannot open";
+		return false;
+	}
+
+	return true;
+}
+
+bool Merger::Source::Fill()
+{
+	text.Clear();
+	entries.Clear();
+	next = 0;
+
+	while( entries.empty() && !done )
+	{
+		const auto block = decoder ? decoder->Next() : loader->Next();
+		if( block.empty() )
+		{
+			failure = decoder ? decoder->error() : loader->error();
+			done = true;
+
+			// complete the last line
+			if( !failure && last != '\n' )
+			{
+				reader.AddSourceBlock( "\n", 1 );
+			}
+
+			break;
+		}
+
+		last = block.to[-1];
+		reader.AddSourceBlock( block.from, block.length() );
+	}
+
+	return !entries.empty();
+}
@@ -0,0 +1,107 @@
+#ifndef __MERGER_HEADER__
+#define __MERGER_HEADER__
+
+#include "decoder.h"
+#include "loader.h"
+
+#include "logreader.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Prints the matching lines of several files as a single stream ordered by the timestamps at their beginnings.
+// Every file has its own reader producing its matching lines in order; the heads of the files are kept in
+// a binary heap and the earliest one is printed. A file is read a block further only when all its lines taken
+// so far have been printed, so the lines buffered per file are at most the matching ones of a block.
+// A line without a timestamp (e.g. of a stack trace) takes the one of the preceding matching line of its file,
+// equal timestamps keep the order of the files. The lines of a file keep their order even if it is not sorted.
+class Merger
+{
+public:
+	// nanoseconds since the epoch of a timestamp at the beginning of the line, after an optional '[', '(' or quote:
+	//   2026-10-19T12:34:56.789+02:00, 2026-10-19 12:34:56,789 (ISO 8601 and the like, the zone may be omitted)
+	//   19/Oct/2026:12:34:56 +0200 (the common log format of the web servers)
+	//   Oct 19 12:34:56 (syslog, without the year, taken as 1970)
+	// a timestamp without the zone is taken as is, returns false if there is none
+	static bool Timestamp( const Sequence<char>& line, int64_t& time );
+
+	// the paths of the files, '-' for the standard input; gzip and zstd files are decompressed
+	Merger( const char* const* paths, size_t count, Loader::Backend = Loader::URING, bool direct = false );
+	~Merger();
+
+	Merger( const Merger& ) = delete;
+	Merger& operator=( const Merger& ) = delete;
+
+	bool SetFilter( const char*, unsigned options = 0 ); // options are a combination of Filter flags
+	bool SetField( const char* ); // see CLogReader::SetField
+	void SetLimit( const LineLimit& ); // see CLogReader::SetLimit
+
+	// prints the matching lines to the file, returns false on an error reading one of the files
+	bool Run( FILE* );
+
+	const char* error() const { return failure; } // nullptr if no error
+	const char* path() const { return failed; } // of the file causing the error
+
+	bool labels = false; // prefixes the lines with the paths of their files like grep does for several files
+	bool numbers = false; // then with their numbers in the files like grep -n
+
+private:
+	// a matching line copied out of the block, with its sort key
+	struct Entry
+	{
+		size_t offset, length; // in the text of the source
+		size_t number;
+		int64_t time;
+	};
+
+	struct Source : CLogReader::Handler
+	{
+		Source();
+		~Source();
+
+		void Handle( const Sequence<Line>& ) override;
+
+		bool Open( Loader::Backend, bool direct );
+
+		// reads blocks until some matching lines are buffered or the file ends, returns false if none are
+		bool Fill();
+
+		const Entry& head() { return entries[next]; }
+		Sequence<char> line( const Entry& entry ) const { return { text.data().from + entry.offset, text.data().from + entry.offset + entry.length }; }
+
+		const char* path = nullptr;
+		const char* label = nullptr;
+
+		CLogReader reader;
+
+		Loader* loader = nullptr; // or the decoder for a compressed file
+		Decoder* decoder = nullptr;
+
+		Buffer<char> text; // of the buffered lines
+		Buffer<Entry> entries;
+		size_t next = 0; // the first entry not printed yet
+
+		int64_t time = INT64_MIN; // of the last line having a timestamp
+		char last = '\n'; // the last byte read
+		bool done = false;
+
+		const char* failure = nullptr;
+	};
+
+	bool Less( size_t a, size_t b ) const; // compares the heads of the sources
+	void Down( size_t i ); // restores the heap below the position
+
+	Source* sources;
+	const size_t count;
+
+	const Loader::Backend io;
+	const bool direct;
+
+	size_t* heap; // indices of the sources having buffered lines
+	size_t size = 0;
+
+	const char* failure = nullptr;
+	const char* failed = nullptr;
+};
+
+#endif // !__MERGER_HEADER__
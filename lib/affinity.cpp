@@ -0,0 +1,294 @@
+#include "affinity.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// reads a number from a sysfs file, returns the default if missing
+static int ReadNumber( const char* path, int dflt )
+{
+	FILE* file = fopen( path, "r" );
+	if( !file )
+	{
+		return dflt;
+	}
+
+	int n;
+	if( fscanf( file, "%d", &n ) != 1 )
+	{
+		n = dflt;
+	}
+
+	fclose(file);
+	return n;
+}
+
+// sorts the indices by the keys, stable
+template< typename Less >
+static void Sort( int* items, size_t n, Less less )
+{
+	for( size_t i = 1; i < n; ++i )
+	{
+		const auto item = items[i];
+
+		auto j = i;
+		for( ; j && less( item, items[j-1] ); --j )
+		{
+			items[j] = items[j-1];
+		}
+
+		items[j] = item;
+	}
+}
+
+Affinity::Affinity()
+{
+	Discover();
+}
+
+void Affinity::Discover()
+{
+#ifdef __linux__
+	cpu_set_t allowed;
+	if( sched_getaffinity( 0, sizeof(allowed), &allowed ) )
+	{
+		return;
+	}
+
+	int last = -1; // node
+	for( int id = 0; id < CPU_SETSIZE && ncpus < CPUS; ++id )
+	{
+		if( !CPU_ISSET( id, &allowed ) )
+		{
+			continue;
+		}
+
+		char path[128];
+		auto& cpu = cpus[ ncpus++ ];
+		cpu.id = id;
+
+		snprintf( path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", id );
+		cpu.package = ReadNumber( path, 0 );
+
+		snprintf( path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", id );
+		cpu.core = ReadNumber( path, id );
+
+		// the node is a link named node<n> in the directory of the CPU
+		cpu.node = 0;
+
+		snprintf( path, sizeof(path), "/sys/devices/system/cpu/cpu%d", id );
+		if( DIR* dir = opendir(path) )
+		{
+			while( auto entry = readdir(dir) )
+			{
+				if( !strncmp( entry->d_name, "node", 4 ) && entry->d_name[4] >= '0' && entry->d_name[4] <= '9' )
+				{
+					cpu.node = atoi( entry->d_name + 4 );
+					break;
+				}
+			}
+
+			closedir(dir);
+		}
+
+		cpu.thread = 0;
+		for( size_t i = 0; i + 1 < ncpus; ++i )
+		{
+			cpu.thread += cpus[i].package == cpu.package && cpus[i].core == cpu.core;
+		}
+
+		last = cpu.node > last ? cpu.node : last;
+	}
+
+	// count the nodes having the allowed CPUs
+	nnodes = 0;
+	for( int node = 0; node <= last; ++node )
+	{
+		for( size_t i = 0; i < ncpus; ++i )
+		{
+			if( cpus[i].node == node )
+			{
+				++nnodes;
+				break;
+			}
+		}
+	}
+
+	nnodes = nnodes ? nnodes : 1;
+#endif
+}
+
+bool Affinity::Parse( const char* text )
+{
+	used = 0;
+	plcy = NONE;
+
+	if( !ncpus )
+	{
+		return false;
+	}
+
+	if( !strcmp( text, "compact" ) || !strcmp( text, "scatter" ) )
+	{
+		for( size_t i = 0; i < ncpus; ++i )
+		{
+			order[i] = static_cast< int >(i);
+		}
+
+		Sort( order, ncpus, [this]( int l, int r )
+		{
+			const auto &a = cpus[l], &b = cpus[r];
+			return a.node != b.node ? a.node < b.node : a.package != b.package ? a.package < b.package :
+				a.core != b.core ? a.core < b.core : a.thread < b.thread;
+		});
+
+		used = ncpus;
+		plcy = COMPACT;
+
+		if( !strcmp( text, "compact" ) )
+		{
+			return true;
+		}
+
+		// the rank of every core within its node in the compact order
+		int ranks[CPUS];
+		for( size_t i = 0; i < ncpus; ++i )
+		{
+			const auto& cpu = cpus[ order[i] ];
+
+			int rank = 0;
+			for( size_t j = 0; j < i; ++j )
+			{
+				const auto& other = cpus[ order[j] ];
+				rank += other.node == cpu.node && other.thread == 0;
+			}
+
+			ranks[ order[i] ] = cpu.thread ? rank - 1 : rank;
+		}
+
+		// the first hyperthreads of the first cores of every node, then of the second ones...
+		Sort( order, ncpus, [this, &ranks]( int l, int r )
+		{
+			const auto &a = cpus[l], &b = cpus[r];
+			return a.thread != b.thread ? a.thread < b.thread : ranks[l] != ranks[r] ? ranks[l] < ranks[r] : a.node < b.node;
+		});
+
+		plcy = SCATTER;
+		return true;
+	}
+
+	// a list of CPUs and ranges
+	for( auto p = text; *p; )
+	{
+		char* end;
+		const auto from = strtol( p, &end, 10 );
+		auto to = from;
+
+		if( end == p )
+		{
+			return false;
+		}
+
+		if( *end == '-' )
+		{
+			p = end+1;
+			to = strtol( p, &end, 10 );
+			if( end == p || to < from )
+			{
+				return false;
+			}
+		}
+
+		if( *end && *end != ',' )
+		{
+			return false;
+		}
+
+		for( auto id = from; id <= to; ++id )
+		{
+			size_t i = 0;
+			for( ; i < ncpus && cpus[i].id != id; ++i );
+
+			if( i == ncpus || used == CPUS )
+			{
+				used = 0;
+				return false; // not allowed
+			}
+
+			order[ used++ ] = static_cast< int >(i);
+		}
+
+		p = *end ? end+1 : end;
+	}
+
+	plcy = used ? LIST : NONE;
+	return used;
+}
+
+int Affinity::Cpu( size_t worker ) const
+{
+	return used ? cpus[ order[ worker % used ] ].id : -1;
+}
+
+int Affinity::Node( size_t worker ) const
+{
+	return used ? cpus[ order[ worker % used ] ].node : -1;
+}
+
+bool Affinity::Pin( pthread_attr_t& attr, size_t worker ) const
+{
+#ifdef __linux__
+	if( !used )
+	{
+		return false;
+	}
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET( Cpu(worker), &set );
+
+	return !pthread_attr_setaffinity_np( &attr, sizeof(set), &set );
+#else
+	return false;
+#endif
+}
+
+bool Affinity::Place( void* memory, size_t size, size_t worker ) const
+{
+	return used && Bind( memory, size, Node(worker) );
+}
+
+bool Affinity::Bind( void* memory, size_t size, int node )
+{
+#ifdef __linux__
+	if( node < 0 || node >= 1024 )
+	{
+		return false;
+	}
+
+	const auto page = static_cast< size_t >( sysconf(_SC_PAGESIZE) );
+
+	const auto from = (reinterpret_cast< size_t >(memory) + page - 1) / page * page;
+	const auto to = (reinterpret_cast< size_t >(memory) + size) / page * page;
+	if( from >= to )
+	{
+		return true; // no whole page
+	}
+
+	unsigned long mask[ 1024 / (8 * sizeof(unsigned long)) ] = {};
+	mask[ node / (8 * sizeof(unsigned long)) ] = 1ul << (node % (8 * sizeof(unsigned long)));
+
+	// the pages touched later are allocated on the node, the present ones are moved
+	return !syscall( SYS_mbind, from, to - from, MPOL_PREFERRED, mask, 8 * sizeof(mask) + 1, MPOL_MF_MOVE );
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,56 @@
+#ifndef __AFFINITY_HEADER__
+#define __AFFINITY_HEADER__
+
+#include <pthread.h>
+#include <stddef.h>
+
+// Placement of the workers on the CPUs and of the memory they use on the NUMA nodes of the CPUs.
+// The CPUs allowed to the process and their nodes, packages and cores are read from sysfs.
+// COMPACT fills the CPUs in order, the hyperthreads of a core and the cores of a node next to each other,
+// SCATTER spreads the workers over the nodes first, then over the cores of every node.
+// Only on Linux; elsewhere nothing is pinned or placed.
+class Affinity
+{
+public:
+	static constexpr size_t CPUS = 1024; // maximum number of the CPUs
+
+	enum Policy { NONE, COMPACT, SCATTER, LIST };
+
+	Affinity(); // NONE
+
+	// "compact", "scatter" or a list of CPUs like "0-3,8,10"; returns false if invalid or none is allowed
+	bool Parse( const char* );
+
+	Policy policy() const { return plcy; }
+	size_t size() const { return used; } // number of the CPUs to pin to, the workers wrap around them
+	size_t nodes() const { return nnodes; } // number of the NUMA nodes known
+
+	int Cpu( size_t worker ) const; // -1 if not pinned
+	int Node( size_t worker ) const; // -1 if unknown
+
+	bool Pin( pthread_attr_t&, size_t worker ) const; // pins the thread to be created with the attributes
+
+	// moves the pages within the memory to the node of the worker and keeps them there
+	// only the whole pages are moved, returns false if not supported
+	bool Place( void* memory, size_t size, size_t worker ) const;
+	static bool Bind( void* memory, size_t size, int node );
+
+private:
+	struct Processor
+	{
+		int id, node, package, core;
+		int thread; // index among the hyperthreads of the core
+	};
+
+	void Discover();
+
+	Policy plcy = NONE;
+
+	Processor cpus[CPUS]; // allowed ones, ordered by id
+	size_t ncpus = 0, nnodes = 1;
+
+	int order[CPUS]; // indices in cpus to pin the workers to
+	size_t used = 0;
+};
+
+#endif // !__AFFINITY_HEADER__
@@ -0,0 +1,230 @@
+#include "aggregator.h"
+#include "hash.h"
+
+Aggregator::Aggregator( uint32_t grps, size_t lmt, bool sktch ) : groups(grps), limit( lmt ? lmt : 1 ), sketch(sktch)
+{
+	entries = new Entry[limit];
+
+	// keep the load factor at most 1/2
+	size_t capacity = 2;
+	while( capacity < 2 * limit ) capacity *= 2;
+
+	mask = capacity - 1;
+	slots = new uint32_t[capacity];
+	memset( slots, 0, capacity * sizeof(uint32_t) );
+}
+
+Aggregator::~Aggregator()
+{
+	delete[] entries;
+	delete[] slots;
+}
+
+void Aggregator::Handle( const Line&, const Line* captures )
+{
+	char key[KEY];
+	size_t length = 0;
+
+	for( size_t i = 0; i < WildcardMatcher::CAPTURES; ++i )
+	{
+		if( !(groups & (1u << i)) )
+		{
+			continue;
+		}
+
+		if( length && length < KEY )
+		{
+			key[ length++ ] = '\t';
+		}
+
+		const auto& capture = captures[i];
+		const auto n = capture.length() < KEY - length ? capture.length() : KEY - length;
+
+		memcpy( key + length, capture.from, n );
+		length += n;
+	}
+
+	++total;
+	Insert( Hash( key, length ), {key, key + length}, 1 );
+}
+
+void Aggregator::Merge( Aggregator& other )
+{
+	for( size_t i = 0; i < other.size; ++i )
+	{
+		const auto& entry = other.entries[i];
+		Insert( entry.hash, other.key(entry), entry.count );
+	}
+
+	total += other.total;
+	dropped += other.dropped;
+	error += other.error;
+
+	other.Clear();
+}
+
+size_t Aggregator::Top( const Entry** top, size_t k ) const
+{
+	// keep a min-heap of the k largest entries
+	size_t n = 0;
+
+	auto less = []( const Entry* a, const Entry* b ) { return a->count < b->count; };
+
+	auto down = [&]( size_t i, size_t n )
+	{
+		while(true)
+		{
+			auto least = i;
+			auto l = 2*i + 1, r = l + 1;
+
+			if( l < n && less( top[l], top[least] ) ) least = l;
+			if( r < n && less( top[r], top[least] ) ) least = r;
+
+			if( least == i ) break;
+
+			auto tmp = top[i];
+			top[i] = top[least];
+			top[least] = tmp;
+
+			i = least;
+		}
+	};
+
+	for( size_t i = 0; i < size && k; ++i )
+	{
+		const auto entry = entries + i;
+		if( n < k )
+		{
+			// sift up
+			auto j = n++;
+			top[j] = entry;
+
+			for( ; j > 0 && less( top[j], top[ (j-1) / 2 ] ); j = (j-1) / 2 )
+			{
+				auto tmp = top[j];
+				top[j] = top[ (j-1) / 2 ];
+				top[ (j-1) / 2 ] = tmp;
+			}
+		}
+		else if( less( top[0], entry ) )
+		{
+			top[0] = entry;
+			down( 0, n );
+		}
+	}
+
+	// sort in descending order by popping the minimum to the end
+	for( auto m = n; m > 1; --m )
+	{
+		auto tmp = top[0];
+		top[0] = top[ m-1 ];
+		top[ m-1 ] = tmp;
+
+		down( 0, m-1 );
+	}
+
+	return n;
+}
+
+Sequence<char> Aggregator::key( const Entry& entry ) const
+{
+	auto from = arena.data().from + entry.offset;
+	return { from, from + entry.length };
+}
+
+void Aggregator::Insert( uint64_t hash, const Sequence<char>& key, size_t count )
+{
+	while(true)
+	{
+		auto i = hash & mask;
+		for( ; slots[i]; i = (i+1) & mask )
+		{
+			auto& entry = entries[ slots[i] - 1 ];
+			if( entry.hash == hash && entry.length == key.length() && memcmp( arena.data().from + entry.offset, key.from, key.length() ) == 0 )
+			{
+				entry.count += count;
+				return;
+			}
+		}
+
+		if( size < limit )
+		{
+			entries[size] = { hash, count, arena.size(), key.length() };
+			slots[i] = uint32_t( ++size );
+
+			arena.Append(key);
+			return;
+		}
+
+		if( !sketch )
+		{
+			dropped += count;
+			return;
+		}
+
+		// decrement all the counters including the new one by the smallest of them
+		auto least = count;
+		for( size_t j = 0; j < size; ++j )
+		{
+			least = entries[j].count < least ? entries[j].count : least;
+		}
+
+		Prune(least);
+
+		count -= least;
+		error += least;
+
+		if( !count )
+		{
+			return;
+		}
+	}
+}
+
+void Aggregator::Prune( size_t n )
+{
+	Buffer<char> compacted;
+
+	size_t kept = 0;
+	for( size_t i = 0; i < size; ++i )
+	{
+		auto entry = entries[i];
+		if( entry.count > n )
+		{
+			const auto k = key(entry);
+
+			entry.count -= n;
+			entry.offset = compacted.size();
+			compacted.Append(k);
+
+			entries[ kept++ ] = entry;
+		}
+	}
+
+	size = kept;
+	arena = static_cast< Buffer<char>&& >(compacted);
+
+	Index();
+}
+
+void Aggregator::Index()
+{
+	memset( slots, 0, (mask+1) * sizeof(uint32_t) );
+
+	for( size_t i = 0; i < size; ++i )
+	{
+		auto j = entries[i].hash & mask;
+		for( ; slots[j]; j = (j+1) & mask );
+
+		slots[j] = uint32_t( i+1 );
+	}
+}
+
+void Aggregator::Clear()
+{
+	size = 0;
+	total = dropped = error = 0;
+
+	arena.Clear();
+	memset( slots, 0, (mask+1) * sizeof(uint32_t) );
+}
@@ -0,0 +1,72 @@
+#ifndef __AGGREGATOR_HEADER__
+#define __AGGREGATOR_HEADER__
+
+#include "basic.h"
+#include "matcher.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A BasicLogReader handler counting the distinct values captured by the '*' of the filter.
+// The key of a line is its selected captures joined with '\t'.
+// Keeps at most 'limit' distinct keys: when the table is full, lines with new keys are either
+// dropped or, in the sketch mode, the table turns into a Misra-Gries heavy-hitters summary
+// where every count is underestimated by at most 'error'.
+class Aggregator
+{
+public:
+	using Line = Sequence<char>;
+
+	static constexpr size_t KEY = 256; // maximum key length, longer keys are truncated
+	static constexpr size_t LIMIT = 16 * 1024; // default maximum number of distinct keys
+
+	struct Entry
+	{
+		uint64_t hash;
+		size_t count;
+
+		size_t offset, length; // the key in the arena
+	};
+
+	// 'groups' is a bit mask of the captures making the key
+	Aggregator( uint32_t groups = ~0u, size_t limit = LIMIT, bool sketch = false );
+	Aggregator( const Aggregator& ) = delete;
+	~Aggregator();
+
+	Aggregator& operator=( const Aggregator& ) = delete;
+
+	void Handle( const Line&, const Line* captures );
+	void Merge( Aggregator& );
+
+	// stores up to k most frequent entries in descending count order, returns their number
+	size_t Top( const Entry** top, size_t k ) const;
+
+	Sequence<char> key( const Entry& ) const;
+
+	size_t total = 0; // number of the aggregated lines
+	size_t dropped = 0; // number of the lines not counted due to the limit
+	size_t error = 0; // maximum undercount of a key in the sketch mode
+
+private:
+	void Insert( uint64_t hash, const Sequence<char>& key, size_t count );
+
+	// subtracts the given count from every entry and drops the exhausted ones
+	void Prune( size_t );
+
+	void Index(); // rebuilds the slots
+	void Clear();
+
+	const uint32_t groups;
+	const size_t limit;
+	const bool sketch;
+
+	Entry* entries; // in order of the first appearance
+	size_t size = 0;
+
+	uint32_t* slots; // open addressing table of entry indices + 1
+	size_t mask;
+
+	Buffer<char> arena;
+};
+
+#endif // !__AGGREGATOR_HEADER__
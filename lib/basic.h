@@ -3,6 +3,7 @@
 
 #include <assert.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
 template< typename T = char >
@@ -109,14 +110,15 @@ inline void Buffer<T>::Append( const Sequence<T>& seq )
 {
 	Reserve( sz + seq.length() );
 
-	memcpy( dt+sz, seq.from, seq.length() );
+	memcpy( dt+sz, seq.from, seq.length() * sizeof(T) );
 	sz += seq.length();
 }
 
 template< typename T >
 inline void Buffer<T>::Resize( size_t size )
 {
-	Reserve( sz = size );
+	Reserve(size);
+	sz = size;
 }
 
 template< typename T >
@@ -167,4 +169,34 @@ inline void Buffer<T>::Cleanup()
 	delete[] dt;
 }
 
+// the maximum length of a line and what becomes of a longer one
+// a line is carried between the blocks by its first length+1 bytes only, so an endless one takes bounded memory
+struct LineLimit
+{
+	enum Policy { TRUNCATE, SKIP };
+
+	size_t length = SIZE_MAX; // none by default
+	Policy policy = TRUNCATE;
+
+	// cuts the line to the length, returns false if it is to be passed over instead
+	bool Apply( Sequence<char>& line ) const
+	{
+		if( line.length() <= length )
+		{
+			return true;
+		}
+
+		line.to = line.from + length;
+		return policy == TRUNCATE;
+	}
+
+	// appends the piece of a line to its carried beginning, up to one byte past the length
+	void Carry( Buffer<char>& tail, const Sequence<char>& piece ) const
+	{
+		const auto kept = length < SIZE_MAX ? length + 1 : SIZE_MAX;
+		const auto room = tail.size() < kept ? kept - tail.size() : 0;
+		tail.Append( { piece.from, piece.length() <= room ? piece.to : piece.from + room } );
+	}
+};
+
 #endif // __BASIC_HEADER__
@@ -0,0 +1,371 @@
+#ifndef __BASICLOGREADER_HEADER__
+#define __BASICLOGREADER_HEADER__
+
+#include "affinity.h"
+#include "basic.h"
+#include "matcher.h"
+#include "newlines.h"
+#include "stats.h"
+#include "tuner.h"
+
+#include <pthread.h>
+
+// A compile-time bound counterpart of CLogReader.
+// The handler is called right from the worker loop, so it can be inlined into the matching code.
+// Every worker owns a separate handler instance, the instances are merged in the input order
+// into the main handler on the calling thread at the end of each AddSourceBlock.
+//
+// Handler requirements:
+//   constructible from the arguments of the BasicLogReader constructor
+//   void Handle( const Sequence<char>& line ); // called for every matching line
+//   or
+//   void Handle( const Sequence<char>& line, const Sequence<char>* captures ); // also gets the text matched by each '*'
+//   void Merge( Handler& other ); // takes over and resets the other's results
+template< typename Handler, typename Matcher = WildcardMatcher >
+class BasicLogReader
+{
+	static constexpr size_t WORKERS = 4; // maximum workers number
+	static constexpr size_t BLOCK = 256 * 1024; // minimal block size per worker
+
+	using Text = Sequence<char>;
+
+public:
+	using Line = Sequence<char>;
+
+	template< typename... Args >
+	explicit BasicLogReader( const Args&... );
+	~BasicLogReader();
+
+	BasicLogReader( const BasicLogReader& ) = delete;
+	BasicLogReader& operator=( const BasicLogReader& ) = delete;
+
+	bool SetFilter( const char*, unsigned options = 0 ); // options are a combination of Filter flags
+	bool SetField( const char* name ) { return matcher.SetField(name); } // if the Matcher supports it
+	void SetAffinity( const Affinity* ); // pins the workers to the CPUs, nullptr to stop
+	void SetTuner( Tuner* tnr ) { tuner = tnr; } // splits the blocks among the workers as tuned, nullptr for the fixed split
+	void SetLimit( const LineLimit& lmt ) { limit = lmt; } // a longer line is matched by its first bytes or passed over
+
+	bool AddSourceBlock( const char*, const size_t );
+
+	Handler& handler() { return main; }
+
+private:
+	static constexpr bool CAPTURING = requires( Handler& handler, const Line& line, const Line* captures )
+	{
+		handler.Handle( line, captures );
+	};
+
+	static constexpr bool SEEKABLE = requires( const Matcher& matcher, const Line& text )
+	{
+		matcher.Seek(text);
+	};
+
+	// returns a pointer to unprocessed trailing piece
+	// the line breaks are found by the scanner if given
+	static const char* Process( const Text&, const Matcher&, Handler&, Newlines::Scanner* = nullptr, const LineLimit& = LineLimit() );
+
+	// distributes work among the workers
+	// returns the number of workers involved
+	size_t Dispatch( const Text& );
+
+	struct Worker
+	{
+		void Start( const Text& block, const Text& slice, const Matcher&, Newlines& ); // starts asynchronous work
+		void Wait(); // waits until finishes
+
+		Handler* handler;
+
+		static void* Work( void* param ); // thread func
+
+		const Matcher* matcher;
+		const LineLimit* limit;
+		Newlines* newlines;
+
+		Text block, slice; // the worker builds the bits of the slice of the block
+		Text text; // the lines starting within the slice, set by the worker
+
+		pthread_t thread;
+
+		const Affinity* affinity = nullptr;
+		size_t index;
+
+		// measured only while tuning
+		bool timed = false;
+		double launched, started, finished;
+	};
+
+	Worker workers[WORKERS];
+
+	Handler main;
+	Matcher matcher;
+
+	Newlines newlines; // of the block passed to the workers
+
+	Tuner* tuner = nullptr;
+
+	LineLimit limit;
+
+	bool ready = false;
+
+	Buffer<char> tail; // holds unprocessed piece from the previous, up to the limit
+};
+
+template< typename Handler, typename Matcher >
+template< typename... Args >
+inline BasicLogReader< Handler, Matcher >::BasicLogReader( const Args&... args ) : main( args... )
+{
+	for( size_t i = 0; i < WORKERS; ++i )
+	{
+		workers[i].handler = new Handler( args... );
+		workers[i].index = i;
+		workers[i].limit = &limit;
+	}
+}
+
+template< typename Handler, typename Matcher >
+inline BasicLogReader< Handler, Matcher >::~BasicLogReader()
+{
+	for( auto& worker : workers )
+	{
+		delete worker.handler;
+	}
+}
+
+template< typename Handler, typename Matcher >
+inline bool BasicLogReader< Handler, Matcher >::SetFilter( const char* fltr, unsigned options )
+{
+	return (ready = matcher.Set( fltr, options ));
+}
+
+template< typename Handler, typename Matcher >
+inline void BasicLogReader< Handler, Matcher >::SetAffinity( const Affinity* afnt )
+{
+	for( auto& worker : workers )
+	{
+		worker.affinity = afnt && afnt->size() ? afnt : nullptr;
+	}
+}
+
+template< typename Handler, typename Matcher >
+bool BasicLogReader< Handler, Matcher >::AddSourceBlock( const char* block, const size_t block_size )
+{
+	assert( block && block_size );
+	if( !ready || !block || !block_size )
+	{
+		return false;
+	}
+
+	Text text{ block, block + block_size };
+
+	// look for the rest of the unprocessed piece left from the previous run
+	if( !tail.empty() )
+	{
+		auto ln = static_cast< const char* >( memchr( text.from, '\n', block_size ) );
+
+		if( !ln )
+		{
+			limit.Carry( tail, text );
+			return true;
+		}
+
+		limit.Carry( tail, {text.from, ln} );
+		tail.Append('\n');
+		text.from = ln+1;
+	}
+
+	Buffer<char> extra( static_cast< Buffer<char>&& >(tail) ); // clear tail before dispatching
+	assert( tail.empty() );
+
+	auto n = Dispatch(text);
+	assert( n > 0 );
+
+	// synchronously process the extra piece
+	if( !extra.empty() )
+	{
+		[[maybe_unused]] auto p = Process( extra.data(), matcher, main, nullptr, limit );
+		assert( p == extra.data().to );
+	}
+
+	// wait for the workers to finish and merge the results in proper order
+	for( size_t i = 0; i < n; ++i )
+	{
+		auto& worker = workers[i];
+		worker.Wait();
+
+		main.Merge( *worker.handler );
+	}
+
+	if( tuner && workers[0].timed )
+	{
+		double delay = 0, busy = 0;
+		for( size_t i = 0; i < n; ++i )
+		{
+			delay += workers[i].started - workers[i].launched;
+			busy += workers[i].finished - workers[i].started;
+		}
+
+		tuner->Record( text.length(), n, Stats::Wall() - workers[0].launched, delay / n, busy / n );
+	}
+
+	// store the unprocessed piece following the last line break
+	const auto ln = newlines.Previous( text.from, text.to );
+	const auto rest = ln ? ln+1 : text.from;
+
+	if( rest != text.to )
+	{
+		limit.Carry( tail, {rest, text.to} );
+	}
+
+	return true;
+}
+
+template< typename Handler, typename Matcher >
+size_t BasicLogReader< Handler, Matcher >::Dispatch( const Text& text )
+{
+	const auto total = text.length();
+
+	auto n = total <= BLOCK ? 1 : total / BLOCK;
+	n = n <= WORKERS ? n : WORKERS;
+	n = tuner ? tuner->Split(total) : n;
+
+	assert( n > 0 && n <= WORKERS );
+
+	// equal slices at multiples of 64 bytes, every worker takes the lines starting within its slice
+	const auto slice = (total / n + 63) / 64 * 64;
+	assert( n == 1 || slice * (n-1) < total );
+
+	newlines.Reset(text);
+
+	const bool timed = tuner && !tuner->settled();
+	for( size_t i = 0; i < n; ++i )
+	{
+		const auto from = text.from + slice * i;
+
+		workers[i].timed = timed;
+		workers[i].Start( text, {from, i == n-1 ? text.to : from + slice}, matcher, newlines );
+	}
+
+	return n;
+}
+
+template< typename Handler, typename Matcher >
+inline const char* BasicLogReader< Handler, Matcher >::Process( const Text& seq, const Matcher& matcher, Handler& handler,
+	Newlines::Scanner* scanner, const LineLimit& limit )
+{
+	const char* ps = seq.from; // sliding pointer to the text
+	const char* const end = seq.to;
+
+	bool seeking = false;
+	if constexpr(SEEKABLE)
+	{
+		seeking = scanner && matcher.seekable();
+	}
+
+	size_t skipped = 0; // counted by the scanner, not needed
+	while( ps != end )
+	{
+		if constexpr(SEEKABLE)
+		{
+			if(seeking)
+			{
+				// pass over the lines lacking the literal required by the filter
+				const auto hit = matcher.Seek( {ps, end} );
+				ps = scanner->Skip( ps, hit ? hit : end, skipped );
+
+				if( !hit )
+				{
+					return ps;
+				}
+			}
+		}
+
+		auto ln = scanner ? scanner->Next( ps, end ) : static_cast< const char* >( memchr( ps, '\n', end - ps ) );
+		if( !ln )
+		{
+			return ps; // return the unprocessed piece
+		}
+
+		Line line{ ps, ln };
+		if( !limit.Apply(line) )
+		{
+			ps = ln+1;
+			continue;
+		}
+
+		if constexpr(CAPTURING)
+		{
+			Line captures[ Matcher::CAPTURES ];
+			if( matcher.Match( line, captures ) )
+			{
+				handler.Handle( line, captures );
+			}
+		}
+		else if( matcher.Match(line) )
+		{
+			handler.Handle(line);
+		}
+
+		ps = ln+1;
+	}
+
+	return end;
+}
+
+template< typename Handler, typename Matcher >
+void BasicLogReader< Handler, Matcher >::Worker::Start( const Text& blck, const Text& slc, const Matcher& mtchr, Newlines& nwlns )
+{
+	block = blck;
+	slice = slc;
+	matcher = &mtchr;
+	newlines = &nwlns;
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+
+	if(affinity)
+	{
+		affinity->Pin( attr, index );
+	}
+
+	if(timed)
+	{
+		launched = Stats::Wall();
+	}
+
+	[[maybe_unused]] auto err = pthread_create( &thread, &attr, Work, this );
+	assert( !err );
+
+	pthread_attr_destroy(&attr);
+}
+
+template< typename Handler, typename Matcher >
+void BasicLogReader< Handler, Matcher >::Worker::Wait()
+{
+	pthread_join( thread, nullptr );
+}
+
+template< typename Handler, typename Matcher >
+void* BasicLogReader< Handler, Matcher >::Worker::Work( void* param )
+{
+	auto ths = reinterpret_cast< Worker* >(param);
+	if( ths->timed )
+	{
+		ths->started = Stats::Wall();
+	}
+
+	Newlines::Scanner scanner( *ths->newlines, ths->slice );
+
+	ths->text = scanner.Lines( ths->block );
+	Process( ths->text, *ths->matcher, *ths->handler, &scanner, *ths->limit ); // the unterminated tail is found in the bits
+
+	scanner.Complete(); // the bits of the whole block are used after the workers finish
+
+	if( ths->timed )
+	{
+		ths->finished = Stats::Wall();
+	}
+
+	return nullptr;
+}
+
+#endif // !__BASICLOGREADER_HEADER__
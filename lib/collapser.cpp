@@ -0,0 +1,278 @@
+#include "collapser.h"
+#include "hash.h"
+
+// classes of the bytes for the masking
+enum : uint8_t { ALNUM = 1, HEX = 2, DIGIT = 4 };
+
+struct Classes
+{
+	Classes()
+	{
+		for( int ch = 0; ch < 256; ++ch )
+		{
+			const bool digit = ch >= '0' && ch <= '9';
+			const bool hex = digit || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F');
+			const bool alnum = hex || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+
+			of[ch] = (alnum ? ALNUM : 0) | (hex ? HEX : 0) | (digit ? DIGIT : 0);
+		}
+	}
+
+	uint8_t operator[]( char ch ) const { return of[ static_cast< uint8_t >(ch) ]; }
+
+	uint8_t of[256];
+};
+
+static const Classes classes;
+
+Collapser::Collapser( FILE* out, bool adjcnt, bool mskng, size_t lmt ) : output(out), adjacent(adjcnt), masking(mskng),
+	limit( lmt ? lmt : 1 )
+{
+	if( adjacent )
+	{
+		return;
+	}
+
+	// keep the load factor at most 1/2
+	size_t capacity = 2;
+	while( capacity < 2 * limit ) capacity *= 2;
+
+	mask = capacity - 1;
+	slots = new uint32_t[capacity];
+	memset( slots, 0, capacity * sizeof(uint32_t) );
+}
+
+Collapser::~Collapser()
+{
+	delete[] slots;
+}
+
+Collapser::Line Collapser::Key( const Line& line )
+{
+	if( !masking )
+	{
+		return line;
+	}
+
+	// every run of letters and digits which is a number, decimal or hexadecimal (a digit required, 0x allowed), becomes '#'
+	masked.Resize( line.length() );
+
+	char* const start = &masked[0];
+	char* pw = start;
+
+	for( auto p = line.from; p != line.to; )
+	{
+		if( !(classes[*p] & ALNUM) )
+		{
+			*pw++ = *p++;
+			continue;
+		}
+
+		const bool prefix = line.to - p > 2 && p[0] == '0' && (p[1] | 0x20) == 'x' && classes[ p[2] ] & HEX;
+
+		auto q = prefix ? p+2 : p;
+		uint8_t all = HEX, any = prefix ? DIGIT : 0;
+
+		for( uint8_t c; q != line.to && (c = classes[*q]) & ALNUM; ++q )
+		{
+			all &= c;
+			any |= c;
+		}
+
+		if( all & HEX && any & DIGIT )
+		{
+			*pw++ = '#';
+		}
+		else
+		{
+			memcpy( pw, p, q - p );
+			pw += q - p;
+		}
+
+		p = q;
+	}
+
+	masked.Resize( pw - start );
+	return masked.data();
+}
+
+void Collapser::Handle( const Line& line )
+{
+	++total;
+
+	const auto k = Key(line);
+	const auto hash = Hash( k.from, k.length() );
+
+	if(adjacent)
+	{
+		if( !entries.empty() && Equal( entries[ entries.size()-1 ], hash, k ) )
+		{
+			++entries[ entries.size()-1 ].count;
+		}
+		else
+		{
+			Add( hash, k, line, 1 );
+		}
+
+		return;
+	}
+
+	if( auto entry = Find( hash, k, line ) )
+	{
+		++entry->count;
+	}
+	else
+	{
+		++dropped;
+	}
+}
+
+void Collapser::Merge( Collapser& other )
+{
+	for( size_t i = 0; i < other.entries.size(); ++i )
+	{
+		const auto& entry = other.entries[i];
+		const auto k = other.key(entry);
+
+		if(adjacent)
+		{
+			if( !entries.empty() && Equal( entries[ entries.size()-1 ], entry.hash, k ) )
+			{
+				entries[ entries.size()-1 ].count += entry.count;
+			}
+			else
+			{
+				Add( entry.hash, k, other.line(entry), entry.count );
+			}
+		}
+		else if( auto found = Find( entry.hash, k, other.line(entry) ) )
+		{
+			found->count += entry.count;
+		}
+		else
+		{
+			dropped += entry.count;
+		}
+	}
+
+	total += other.total;
+	dropped += other.dropped;
+
+	other.total = other.dropped = 0;
+	other.Clear();
+
+	// only the last run may go on
+	if( adjacent && entries.size() > 1 )
+	{
+		Print( 0, entries.size()-1 );
+		Clear(true);
+	}
+}
+
+void Collapser::Finish()
+{
+	Print( 0, entries.size() );
+	Clear();
+}
+
+Collapser::Entry* Collapser::Find( uint64_t hash, const Line& key, const Line& line )
+{
+	auto i = hash & mask;
+	for( ; slots[i]; i = (i+1) & mask )
+	{
+		auto& entry = entries[ slots[i] - 1 ];
+		if( Equal( entry, hash, key ) )
+		{
+			return &entry;
+		}
+	}
+
+	if( entries.size() == limit )
+	{
+		return nullptr;
+	}
+
+	Add( hash, key, line, 0 );
+	slots[i] = uint32_t( entries.size() );
+
+	return &entries[ entries.size()-1 ];
+}
+
+void Collapser::Add( uint64_t hash, const Line& key, const Line& line, size_t count )
+{
+	Entry entry{ hash, count, arena.size(), line.length(), arena.size(), key.length() };
+	arena.Append(line);
+
+	if(masking)
+	{
+		entry.key = arena.size();
+		arena.Append(key);
+	}
+
+	entries.Append(entry);
+}
+
+bool Collapser::Equal( const Entry& entry, uint64_t hash, const Line& k ) const
+{
+	return entry.hash == hash && entry.size == k.length() && !memcmp( key(entry).from, k.from, k.length() );
+}
+
+Collapser::Line Collapser::line( const Entry& entry ) const
+{
+	const auto from = arena.data().from + entry.offset;
+	return { from, from + entry.length };
+}
+
+Collapser::Line Collapser::key( const Entry& entry ) const
+{
+	const auto from = arena.data().from + entry.key;
+	return { from, from + entry.size };
+}
+
+void Collapser::Print( size_t from, size_t to )
+{
+	for( auto i = from; i < to; ++i )
+	{
+		const auto& entry = entries[i];
+		const auto text = line(entry);
+
+		fprintf( output, "%zu\t", entry.count );
+		fwrite( text.from, 1, text.length(), output );
+		fputc( '\n', output );
+	}
+}
+
+void Collapser::Clear( bool last )
+{
+	// the buffers keep their memory for the next block
+	Entry kept{};
+	Buffer<char> text;
+
+	if( last && !entries.empty() )
+	{
+		kept = entries[ entries.size()-1 ];
+		text.Append( line(kept) );
+
+		if(masking)
+		{
+			text.Append( key(kept) );
+		}
+	}
+
+	entries.Clear();
+	arena.Clear();
+
+	if( kept.count )
+	{
+		kept.offset = 0;
+		kept.key = masking ? kept.length : 0;
+
+		arena.Append( text.data() );
+		entries.Append(kept);
+	}
+
+	if(slots)
+	{
+		memset( slots, 0, (mask+1) * sizeof(uint32_t) );
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef __COLLAPSER_HEADER__
+#define __COLLAPSER_HEADER__
+
+#include "basic.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// A BasicLogReader handler folding the repeated matching lines into the first of them with their count.
+// A line is keyed by its hash, optionally computed with every run of letters and digits which is a hexadecimal
+// number having a decimal digit masked, so the lines differing only in the timestamps, counters or IDs are folded too.
+// Either every key is kept, the lines printed at the end in the order of their first appearance, and at most 'limit'
+// keys per thread, the lines with new keys are dropped then; or only the runs of adjacent lines are folded,
+// printed as soon as they end.
+// A worker copies only the first line of every key of its piece, the tables are merged in the input order.
+class Collapser
+{
+public:
+	using Line = Sequence<char>;
+
+	static constexpr size_t LIMIT = 16 * 1024; // default maximum number of the keys
+
+	// the output is written by the instance the others are merged into
+	Collapser( FILE* output, bool adjacent = false, bool masking = false, size_t limit = LIMIT );
+	Collapser( const Collapser& ) = delete;
+	~Collapser();
+
+	Collapser& operator=( const Collapser& ) = delete;
+
+	void Handle( const Line& );
+	void Merge( Collapser& );
+
+	void Finish(); // prints the lines not printed yet
+
+	size_t total = 0; // number of the lines handled
+	size_t dropped = 0; // number of the lines not folded due to the limit
+
+private:
+	struct Entry
+	{
+		uint64_t hash;
+		size_t count;
+
+		size_t offset, length; // of the first line in the arena
+		size_t key, size; // of the key in the arena, the line itself unless masked
+	};
+
+	Line Key( const Line& ); // of the line, masked into a buffer valid until the next call
+
+	// returns the entry of the key, added with the line if new and there is room, nullptr if there is not
+	Entry* Find( uint64_t hash, const Line& key, const Line& line );
+	void Add( uint64_t hash, const Line& key, const Line& line, size_t count );
+
+	bool Equal( const Entry&, uint64_t hash, const Line& key ) const;
+
+	Line line( const Entry& ) const;
+	Line key( const Entry& ) const;
+
+	void Print( size_t from, size_t to ); // the entries in the range
+	void Clear( bool last = false ); // all the entries or all but the last one
+
+	FILE* const output;
+
+	const bool adjacent;
+	const bool masking;
+	const size_t limit;
+
+	Buffer<Entry> entries; // in the order of the first appearance
+
+	uint32_t* slots = nullptr; // open addressing table of entry indices + 1, unless adjacent
+	size_t mask = 0;
+
+	Buffer<char> arena;
+	Buffer<char> masked; // the key of the current line
+};
+
+#endif // !__COLLAPSER_HEADER__
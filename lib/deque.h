@@ -19,12 +19,19 @@ public:
 	bool empty() const;
 
 	void Push( T&& );
-	void Clear();
+
+	// calls the function for every item in order, the items may be modified
+	template< typename Function >
+	void Each( Function );
+
+	void Clear(); // retains the blocks for reuse
+	void Shrink(); // frees the retained blocks
 
 private:
 	struct Block;
 
 	Block *first, *last;
+	Block* spare = nullptr; // the retained ones
 };
 
 template< typename T, size_t BLOCK >
@@ -56,7 +63,7 @@ inline void Deque< T, BLOCK >::Block::Push( T&& item )
 {
 	assert( !full() );
 
-	*end = item; // TODO: move
+	*end = static_cast< T&& >(item);
 	to = ++end;
 }
 
@@ -139,6 +146,8 @@ template< typename T, size_t BLOCK >
 inline Deque< T, BLOCK >::~Deque()
 {
 	Clear();
+	Shrink();
+
 	delete first;
 }
 
@@ -166,14 +175,49 @@ inline void Deque< T, BLOCK >::Push( T&& item )
 	last->Push( static_cast< T&& >(item) );
 	if( last->full() )
 	{
-		last = last->next = new Block();
+		auto block = spare;
+		if(block)
+		{
+			spare = block->next;
+			block->Reset();
+		}
+		else
+			block = new Block();
+
+		last = last->next = block;
+	}
+}
+
+template< typename T, size_t BLOCK >
+template< typename Function >
+inline void Deque< T, BLOCK >::Each( Function function )
+{
+	for( auto block = first; block; block = block->next )
+	{
+		for( auto item = block->items; item != block->end; ++item )
+		{
+			function(*item);
+		}
 	}
 }
 
 template< typename T, size_t BLOCK >
 inline void Deque< T, BLOCK >::Clear()
 {
-	for( auto block = first->next; block; )
+	if( last != first )
+	{
+		last->next = spare;
+		spare = first->next;
+	}
+
+	first->Reset();
+	last = first;
+}
+
+template< typename T, size_t BLOCK >
+inline void Deque< T, BLOCK >::Shrink()
+{
+	for( auto block = spare; block; )
 	{
 		auto next = block->next;
 		delete block;
@@ -181,8 +225,7 @@ inline void Deque< T, BLOCK >::Clear()
 		block = next;
 	}
 
-	first->Reset();
-	last = first;
+	spare = nullptr;
 }
 
 #endif // !__DEQUE_HEADER__
@@ -0,0 +1,389 @@
+#include "expression.h"
+
+class ExpressionMatcher::Parser
+{
+public:
+	Parser( const char* text, unsigned opts ) : p(text), options(opts) {}
+	~Parser();
+
+	// parses the whole text, returns false on a syntax error
+	bool Parse();
+
+	// makes a single-term expression
+	bool Single( const char* filter );
+
+	Buffer<Node> nodes;
+	Buffer<size_t> children;
+	Buffer<char*> terms; // normalized filters
+
+	size_t root = 0;
+
+private:
+	bool Or( size_t& );
+	bool And( size_t& );
+	bool Unary( size_t& );
+	bool Term( size_t& );
+
+	bool Add( const char* filter, size_t& );
+	size_t Add( Node::Kind, const Buffer<size_t>& operands );
+
+	void Skip();
+
+	const char* p;
+	const unsigned options;
+};
+
+ExpressionMatcher::Parser::~Parser()
+{
+	for( size_t i = 0; i < terms.size(); ++i )
+	{
+		delete[] terms[i];
+	}
+}
+
+bool ExpressionMatcher::Parser::Parse()
+{
+	if( !Or(root) )
+	{
+		return false;
+	}
+
+	Skip();
+	return !*p;
+}
+
+bool ExpressionMatcher::Parser::Single( const char* filter )
+{
+	return Add( filter, root );
+}
+
+bool ExpressionMatcher::Parser::Or( size_t& node )
+{
+	Buffer<size_t> operands;
+
+	do
+	{
+		size_t operand;
+		if( !And(operand) )
+		{
+			return false;
+		}
+
+		operands.Append(operand);
+		Skip();
+	}
+	while( *p == '|' && ++p );
+
+	node = operands.size() > 1 ? Add( Node::OR, operands ) : operands[0];
+	return true;
+}
+
+bool ExpressionMatcher::Parser::And( size_t& node )
+{
+	Buffer<size_t> operands;
+
+	do
+	{
+		size_t operand;
+		if( !Unary(operand) )
+		{
+			return false;
+		}
+
+		operands.Append(operand);
+		Skip();
+	}
+	while( *p == '&' && ++p );
+
+	node = operands.size() > 1 ? Add( Node::AND, operands ) : operands[0];
+	return true;
+}
+
+bool ExpressionMatcher::Parser::Unary( size_t& node )
+{
+	Skip();
+
+	if( *p == '!' )
+	{
+		++p;
+
+		size_t child;
+		if( !Unary(child) )
+		{
+			return false;
+		}
+
+		Buffer<size_t> operand;
+		operand.Append(child);
+
+		node = Add( Node::NOT, operand );
+		return true;
+	}
+
+	if( *p == '(' )
+	{
+		++p;
+		if( !Or(node) )
+		{
+			return false;
+		}
+
+		Skip();
+		if( *p != ')' )
+		{
+			return false;
+		}
+
+		++p;
+		return true;
+	}
+
+	return Term(node);
+}
+
+bool ExpressionMatcher::Parser::Term( size_t& node )
+{
+	Buffer<char> term;
+	size_t significant = 0; // length without the trailing spaces
+
+	for( ; *p && *p != '&' && *p != '|' && *p != '(' && *p != ')'; ++p )
+	{
+		if( *p == '\\' && p[1] )
+		{
+			term.Append( *++p );
+			significant = term.size();
+		}
+		else
+		{
+			term.Append(*p);
+			if( *p != ' ' )
+			{
+				significant = term.size();
+			}
+		}
+	}
+
+	if( !significant )
+	{
+		return false;
+	}
+
+	term.Resize(significant);
+	term.Append('\0');
+
+	return Add( &term.front(), node );
+}
+
+bool ExpressionMatcher::Parser::Add( const char* filter, size_t& node )
+{
+	auto normalized = Normalize( filter, options );
+	if( !normalized )
+	{
+		return false;
+	}
+
+	if( options & Filter::ICASE )
+	{
+		// fold to make the terms differing only in case equal
+		for( auto pc = normalized; *pc; ++pc )
+		{
+			*pc |= Fold(*pc);
+		}
+	}
+
+	// look for an equal term
+	size_t term = 0;
+	for( ; term < terms.size() && strcmp( terms[term], normalized ); ++term );
+
+	if( term < terms.size() )
+	{
+		delete[] normalized;
+	}
+	else if( terms.size() == TERMS )
+	{
+		delete[] normalized;
+		return false;
+	}
+	else
+	{
+		terms.Append(normalized);
+	}
+
+	// the more literal characters the term has, the less likely it matches
+	// a term anchored at the beginning of a line is rejected quickly
+	const char* pattern = terms[term];
+
+	size_t literal = 0, pieces = 0;
+	for( auto pc = pattern; *pc; ++pc )
+	{
+		literal += *pc != '*' && *pc != '?';
+		pieces += *pc == '*';
+	}
+
+	Node item{ Node::TERM, 0, 0, term, (*pattern == '*' ? 2.0 : 1.0) + pieces, 1.0 / (1 + literal) };
+
+	node = nodes.size();
+	nodes.Append(item);
+
+	return true;
+}
+
+size_t ExpressionMatcher::Parser::Add( Node::Kind kind, const Buffer<size_t>& operands )
+{
+	Node item{ kind, children.size(), operands.size(), 0, 0, 0 };
+	children.Append( operands.data() );
+
+	nodes.Append(item);
+	return nodes.size() - 1;
+}
+
+void ExpressionMatcher::Parser::Skip()
+{
+	for( ; *p == ' '; ++p );
+}
+
+ExpressionMatcher::~ExpressionMatcher()
+{
+	Cleanup();
+}
+
+bool ExpressionMatcher::Set( const char* filter, unsigned options )
+{
+	Cleanup();
+
+	Parser parser( filter, options );
+	if( options & Filter::EXPRESSION ? !parser.Parse() : !parser.Single(filter) )
+	{
+		return false;
+	}
+
+	const auto nterms = parser.terms.size();
+	terms = new WildcardMatcher[nterms];
+	for( size_t i = 0; i < nterms; ++i )
+	{
+		terms[i].Set( parser.terms[i], options & ~Filter::EXPRESSION );
+	}
+
+	nodes = new Node[ parser.nodes.size() ];
+	memcpy( nodes, &parser.nodes.front(), parser.nodes.size() * sizeof(Node) );
+
+	children = new size_t[ parser.children.size() + 1 ];
+	if( !parser.children.empty() )
+	{
+		memcpy( children, &parser.children.front(), parser.children.size() * sizeof(size_t) );
+	}
+
+	root = parser.root;
+	Order( nodes[root] );
+
+	if( nodes[root].kind == Node::TERM )
+	{
+		const auto term = parser.terms[ nodes[root].term ];
+		const auto length = strlen(term);
+
+		auto unanchored = new char[ length + 3 ];
+		unanchored[0] = '*';
+		memcpy( unanchored + 1, term, length );
+		unanchored[ length+1 ] = '*';
+		unanchored[ length+2 ] = 0;
+
+		hint.Set( unanchored, options & ~Filter::EXPRESSION );
+		delete[] unanchored;
+	}
+
+	// a term which every matching line satisfies, the first in the order of evaluation
+	const auto& top = nodes[root];
+	if( top.kind == Node::TERM && terms[ top.term ].seekable() )
+	{
+		key = &terms[ top.term ];
+	}
+
+	for( size_t i = 0; top.kind == Node::AND && !key && i < top.count; ++i )
+	{
+		const auto& node = nodes[ children[ top.first + i ] ];
+		if( node.kind == Node::TERM && terms[ node.term ].seekable() )
+		{
+			key = &terms[ node.term ];
+		}
+	}
+
+	return true;
+}
+
+void ExpressionMatcher::Order( Node& node )
+{
+	if( node.kind == Node::TERM )
+	{
+		return;
+	}
+
+	const auto list = children + node.first;
+	for( size_t i = 0; i < node.count; ++i )
+	{
+		Order( nodes[ list[i] ] );
+	}
+
+	if( node.kind == Node::NOT )
+	{
+		const auto& operand = nodes[ list[0] ];
+
+		node.cost = operand.cost;
+		node.probability = 1 - operand.probability;
+
+		return;
+	}
+
+	// the probability of an operand to decide the result without evaluating the rest
+	const bool conjunction = node.kind == Node::AND;
+	auto decisive = [&]( const Node& operand )
+	{
+		const auto p = conjunction ? 1 - operand.probability : operand.probability;
+		return p > 1e-9 ? p : 1e-9;
+	};
+
+	// evaluating the independent operands in ascending cost / decisiveness gives the least expected cost
+	for( size_t i = 1; i < node.count; ++i )
+	{
+		const auto item = list[i];
+		const auto& operand = nodes[item];
+		const auto key = operand.cost / decisive(operand);
+
+		auto j = i;
+		for( ; j > 0 && nodes[ list[j-1] ].cost / decisive( nodes[ list[j-1] ] ) > key; --j )
+		{
+			list[j] = list[j-1];
+		}
+
+		list[j] = item;
+	}
+
+	// the expected cost is the sum of the operand costs weighted by the probability to reach them
+	double cost = 0, reach = 1;
+	for( size_t i = 0; i < node.count; ++i )
+	{
+		const auto& operand = nodes[ list[i] ];
+
+		cost += reach * operand.cost;
+		reach *= 1 - decisive(operand);
+	}
+
+	node.cost = cost;
+	node.probability = conjunction ? reach : 1 - reach;
+}
+
+void ExpressionMatcher::Cleanup()
+{
+	delete[] terms;
+	terms = nullptr;
+
+	hint.Set( "", Filter::EXPRESSION ); // clears
+	key = nullptr;
+
+	delete[] nodes;
+	nodes = nullptr;
+
+	delete[] children;
+	children = nullptr;
+
+	root = 0;
+}
@@ -0,0 +1,164 @@
+#ifndef __EXPRESSION_HEADER__
+#define __EXPRESSION_HEADER__
+
+#include "basic.h"
+#include "field.h"
+#include "matcher.h"
+
+#include <stdint.h>
+
+// Matches a line against a boolean combination of wildcard filters (terms).
+// With Filter::EXPRESSION the filter is parsed as
+//   expr := and { '|' and }
+//   and := unary { '&' unary }
+//   unary := '!' unary | '(' expr ')' | term
+// where a term is a wildcard filter with the surrounding spaces trimmed and a '\' escaping
+// the next character, e.g. "*ERROR* & !*healthcheck*" or "*timeout* | *refused*".
+// Otherwise the whole filter is a single term.
+//
+// Equal terms are matched once per line. The operands of '&' and '|' are evaluated
+// with short-circuiting, the cheaper and more decisive ones first.
+//
+// A term which the filter requires, the root or an operand of the root '&', lets the lines lacking its longest
+// literal be passed over without evaluating them.
+//
+// Optionally the filter applies to the value of a field of the line instead of the whole line, see Field.
+// A single-term filter is first looked for anywhere in the line, so the field is located only in the lines
+// which can match.
+class ExpressionMatcher
+{
+public:
+	using Line = Sequence<char>;
+
+	static constexpr size_t TERMS = 64; // maximum number of distinct terms
+
+	ExpressionMatcher() = default;
+	ExpressionMatcher( const ExpressionMatcher& ) = delete;
+	~ExpressionMatcher();
+
+	ExpressionMatcher& operator=( const ExpressionMatcher& ) = delete;
+
+	bool Set( const char*, unsigned options = 0 );
+	bool SetField( const char* name ) { return field.Set(name); } // nullptr for the whole line
+
+	bool Match( const Line& ) const;
+
+	// the longest literal of a term which every matching line contains, see WildcardMatcher
+	bool seekable() const { return key; }
+	const char* Seek( const Line& text ) const { return key->Seek(text); }
+
+	bool empty() const { return !nodes; }
+
+private:
+	struct Node
+	{
+		enum Kind { TERM, NOT, AND, OR } kind;
+
+		size_t first, count; // the child nodes are listed in children[ first .. first+count )
+		size_t term; // index of the term of a TERM node
+
+		double cost; // estimated cost of the evaluation
+		double probability; // estimated probability to be true
+	};
+
+	class Parser;
+
+	// results of the terms for the current line
+	struct Cache
+	{
+		uint64_t known = 0, value = 0;
+	};
+
+	bool Evaluate( const Line& ) const;
+	bool Evaluate( const Node&, const Line&, Cache& ) const;
+
+	// estimates the node and orders its children
+	void Order( Node& );
+
+	void Cleanup();
+
+	WildcardMatcher* terms = nullptr;
+
+	Node* nodes = nullptr;
+	size_t* children = nullptr;
+
+	size_t root = 0;
+
+	Field field;
+	WildcardMatcher hint; // the single term anywhere in the line
+
+	const WildcardMatcher* key = nullptr; // the term required by the root, if seekable
+};
+
+inline bool ExpressionMatcher::Match( const Line& line ) const
+{
+	if( field.empty() )
+	{
+		return Evaluate(line);
+	}
+
+	Line value;
+	return (hint.empty() || hint.Match(line)) && field.Find( line, value ) && Evaluate(value);
+}
+
+inline bool ExpressionMatcher::Evaluate( const Line& line ) const
+{
+	const auto& node = nodes[root];
+	if( node.kind == Node::TERM )
+	{
+		return terms[ node.term ].Match(line);
+	}
+
+	Cache cache;
+	return Evaluate( node, line, cache );
+}
+
+inline bool ExpressionMatcher::Evaluate( const Node& node, const Line& line, Cache& cache ) const
+{
+	switch( node.kind )
+	{
+	case Node::TERM:
+	{
+		const uint64_t bit = uint64_t(1) << node.term;
+		if( !(cache.known & bit) )
+		{
+			cache.known |= bit;
+			if( terms[ node.term ].Match(line) )
+			{
+				cache.value |= bit;
+			}
+		}
+
+		return cache.value & bit;
+	}
+
+	case Node::NOT:
+		return !Evaluate( nodes[ children[ node.first ] ], line, cache );
+
+	case Node::AND:
+		for( auto i = node.first; i < node.first + node.count; ++i )
+		{
+			if( !Evaluate( nodes[ children[i] ], line, cache ) )
+			{
+				return false;
+			}
+		}
+
+		return true;
+
+	case Node::OR:
+		for( auto i = node.first; i < node.first + node.count; ++i )
+		{
+			if( Evaluate( nodes[ children[i] ], line, cache ) )
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	return false;
+}
+
+#endif // !__EXPRESSION_HEADER__
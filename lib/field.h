@@ -0,0 +1,372 @@
+#ifndef __FIELD_HEADER__
+#define __FIELD_HEADER__
+
+#include "basic.h"
+#include "simd.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// Locates the value of a named field in a line without parsing the whole line.
+// A line starting with '{' is taken for a JSON object and the field is a key of it, not of the nested objects;
+// the other lines are taken for key=value pairs separated by spaces, like logfmt. A name ending with '='
+// ("level=") is looked up only as a key=value pair. The value of a string is its content without
+// the quotes and with the escapes as is; the value of an object or array is its text.
+//
+// The line is classified 64 bytes at a time in the manner of simdjson: bit masks of the quotes, backslashes
+// and structural characters are computed by the vector kernel, the escaped quotes are found with a carry
+// over the backslash runs and the strings with a prefix XOR of the quotes, so only the structural characters
+// outside the strings are visited one by one.
+class Field
+{
+public:
+	using Line = Sequence<char>;
+
+	Field() = default;
+	Field( const Field& ) = delete;
+	~Field() { delete[] name; }
+
+	Field& operator=( const Field& ) = delete;
+
+	bool Set( const char* ); // nullptr or "" for none, returns false if invalid
+	bool empty() const { return !name; }
+
+	// returns false if the line has no such field
+	bool Find( const Line&, Line& value ) const;
+
+private:
+	class Scanner;
+
+	bool Object( const Line&, Line& value ) const;
+	bool Pairs( const Line&, Line& value ) const;
+
+	bool Equal( const char* from, const char* to ) const { return size_t( to - from ) == length && !memcmp( from, name, length ); }
+
+	char* name = nullptr;
+	size_t length = 0;
+	bool pairs = false; // only key=value pairs
+};
+
+// iterates over the quotes and the given structural characters outside the strings
+class Field::Scanner
+{
+public:
+	static constexpr size_t CHARS = 6; // maximum number of the structural characters
+
+	Scanner( const Line&, const char* structurals );
+
+	const char* Next(); // nullptr at the end of the line
+
+private:
+	bool Load(); // classifies the next 64 bytes
+
+	static uint64_t PrefixXor( uint64_t );
+	static uint64_t Escaped( uint64_t backslashes, uint64_t& carry );
+
+	const char* base = nullptr; // of the current 64 bytes
+	const char* next; // the bytes not classified yet
+	const char* const end;
+
+	char chars[ CHARS + 2 ]; // the quote, the backslash and the structural characters
+	size_t n;
+
+	uint64_t bits = 0; // the positions left in the current 64 bytes
+	uint64_t escaped = 0, inside = 0; // carried over from the previous 64 bytes
+};
+
+inline Field::Scanner::Scanner( const Line& line, const char* structurals ) : next( line.from ), end( line.to )
+{
+	chars[0] = '"';
+	chars[1] = '\\';
+
+	for( n = 2; n < CHARS + 2 && *structurals; ++n )
+	{
+		chars[n] = *structurals++;
+	}
+}
+
+inline const char* Field::Scanner::Next()
+{
+	while( !bits )
+	{
+		if( !Load() )
+		{
+			return nullptr;
+		}
+	}
+
+	const auto p = base + __builtin_ctzll(bits);
+	bits &= bits - 1;
+
+	return p;
+}
+
+inline bool Field::Scanner::Load()
+{
+	if( next == end )
+	{
+		return false;
+	}
+
+	base = next;
+	next = end - base > 64 ? base + 64 : end;
+
+	uint64_t masks[ CHARS + 2 ];
+	if( end - base >= 64 )
+	{
+		Masks( base, chars, n, masks );
+	}
+	else
+	{
+		// the end of the line, padded
+		char last[64] = {};
+		memcpy( last, base, end - base );
+
+		Masks( last, chars, n, masks );
+		for( size_t i = 0; i < n; ++i )
+		{
+			masks[i] &= (uint64_t(1) << (end - base)) - 1;
+		}
+	}
+
+	const auto quotes = masks[0] & ~Escaped( masks[1], escaped );
+
+	// the opening quotes and the characters of the strings, but not the closing quotes
+	const auto strings = PrefixXor(quotes) ^ inside;
+	inside = uint64_t( int64_t(strings) >> 63 );
+
+	uint64_t structurals = 0;
+	for( size_t i = 2; i < n; ++i )
+	{
+		structurals |= masks[i];
+	}
+
+	bits = quotes | (structurals & ~strings);
+	return true;
+}
+
+inline uint64_t Field::Scanner::PrefixXor( uint64_t x )
+{
+	x ^= x << 1;
+	x ^= x << 2;
+	x ^= x << 4;
+	x ^= x << 8;
+	x ^= x << 16;
+	x ^= x << 32;
+
+	return x;
+}
+
+// the characters following an odd number of backslashes, the carry is set if the 64 bytes end with such a run
+inline uint64_t Field::Scanner::Escaped( uint64_t backslashes, uint64_t& carry )
+{
+	constexpr uint64_t EVEN = 0x5555555555555555ull;
+
+	backslashes &= ~carry;
+
+	const uint64_t follows = backslashes << 1 | carry;
+	const uint64_t odd = backslashes & ~EVEN & ~follows; // the runs starting at the odd positions
+
+	uint64_t even;
+	carry = __builtin_add_overflow( odd, backslashes, &even );
+
+	return (EVEN ^ (even << 1)) & follows;
+}
+
+inline bool Field::Set( const char* nm )
+{
+	delete[] name;
+	name = nullptr;
+	length = 0;
+	pairs = false;
+
+	if( !nm || !*nm )
+	{
+		return true;
+	}
+
+	length = strlen(nm);
+	pairs = nm[ length-1 ] == '=';
+	length -= pairs;
+
+	// the name is matched as is, so it cannot contain the characters delimiting it
+	for( size_t i = 0; i < length; ++i )
+	{
+		if( nm[i] == '"' || nm[i] == '\\' || nm[i] == '=' || nm[i] == ' ' || nm[i] == '\t' || nm[i] == '\n' )
+		{
+			length = 0;
+			pairs = false;
+			return false;
+		}
+	}
+
+	if( !length )
+	{
+		pairs = false;
+		return false;
+	}
+
+	name = new char[length];
+	memcpy( name, nm, length );
+
+	return true;
+}
+
+inline bool Field::Find( const Line& line, Line& value ) const
+{
+	auto p = line.from;
+	for( ; p != line.to && (*p == ' ' || *p == '\t'); ++p );
+
+	return !pairs && p != line.to && *p == '{' ? Object( line, value ) : Pairs( line, value );
+}
+
+inline bool Field::Object( const Line& line, Line& value ) const
+{
+	Scanner scanner( line, "{}[]:," );
+
+	int depth = 0;
+	bool key = false; // a string at this point would be a key of the top object
+
+	for( auto p = scanner.Next(); p; p = scanner.Next() )
+	{
+		switch( *p )
+		{
+		case '{':
+		case '[':
+			key = ++depth == 1 && *p == '{';
+			break;
+
+		case '}':
+		case ']':
+			if( --depth <= 0 )
+			{
+				return false; // the end of the top object
+			}
+
+			key = false;
+			break;
+
+		case ',':
+			key = depth == 1;
+			break;
+
+		case ':':
+			key = false;
+			break;
+
+		case '"':
+		{
+			auto close = scanner.Next();
+			if( !close )
+			{
+				return false;
+			}
+
+			if( !key || !Equal( p+1, close ) )
+			{
+				key = false;
+				break;
+			}
+
+			auto colon = scanner.Next();
+			if( !colon || *colon != ':' )
+			{
+				return false;
+			}
+
+			auto from = colon+1;
+			for( ; from != line.to && (*from == ' ' || *from == '\t'); ++from );
+
+			if( from == line.to )
+			{
+				return false;
+			}
+
+			if( *from == '"' )
+			{
+				scanner.Next(); // the opening quote
+				auto to = scanner.Next();
+
+				value = { from+1, to ? to : line.to };
+				return true;
+			}
+
+			if( *from == '{' || *from == '[' )
+			{
+				int nested = 0;
+				for( auto q = scanner.Next(); q; q = scanner.Next() )
+				{
+					if( *q == '{' || *q == '[' )
+					{
+						++nested;
+					}
+					else if( (*q == '}' || *q == ']') && !--nested )
+					{
+						value = { from, q+1 };
+						return true;
+					}
+				}
+
+				return false;
+			}
+
+			// a number, true, false or null up to the next ',' or '}'
+			auto to = scanner.Next();
+			to = to ? to : line.to;
+
+			for( ; to != from && (to[-1] == ' ' || to[-1] == '\t'); --to );
+
+			value = { from, to };
+			return true;
+		}
+		}
+	}
+
+	return false;
+}
+
+inline bool Field::Pairs( const Line& line, Line& value ) const
+{
+	Scanner scanner( line, " \t=" );
+
+	const char* token = line.from; // the beginning of the current pair
+	bool keyed = false; // the '=' of the current pair has been passed
+
+	for( auto p = scanner.Next(); p; p = scanner.Next() )
+	{
+		if( *p == ' ' || *p == '\t' )
+		{
+			token = p+1;
+			keyed = false;
+		}
+		else if( *p == '=' && !keyed )
+		{
+			keyed = true;
+			if( !Equal( token, p ) )
+			{
+				continue;
+			}
+
+			const auto from = p+1;
+			if( from != line.to && *from == '"' )
+			{
+				scanner.Next(); // the opening quote
+				auto to = scanner.Next();
+
+				value = { from+1, to ? to : line.to };
+				return true;
+			}
+
+			// up to the next separator
+			auto to = scanner.Next();
+			for( ; to && *to != ' ' && *to != '\t'; to = scanner.Next() );
+
+			value = { from, to ? to : line.to };
+			return true;
+		}
+	}
+
+	return false;
+}
+
+#endif // !__FIELD_HEADER__
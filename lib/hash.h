@@ -0,0 +1,46 @@
+#ifndef __HASH_HEADER__
+#define __HASH_HEADER__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// a fast non-cryptographic 64-bit hash processing 8 bytes per step
+
+inline uint64_t Mix( uint64_t x )
+{
+	x ^= x >> 32;
+	x *= 0xD6E8FEB86659FD93ULL;
+	x ^= x >> 32;
+	x *= 0xD6E8FEB86659FD93ULL;
+	x ^= x >> 32;
+
+	return x;
+}
+
+inline uint64_t Hash( const char* p, size_t n, uint64_t seed = 0 )
+{
+	constexpr uint64_t K = 0x9E3779B97F4A7C15ULL;
+
+	uint64_t h = seed ^ (n * K);
+	for( ; n >= 8; p += 8, n -= 8 )
+	{
+		uint64_t v;
+		memcpy( &v, p, 8 );
+
+		h = (h ^ v) * K;
+		h ^= h >> 29;
+	}
+
+	if(n)
+	{
+		uint64_t v = 0;
+		memcpy( &v, p, n );
+
+		h = (h ^ v) * K;
+	}
+
+	return Mix(h);
+}
+
+#endif // !__HASH_HEADER__
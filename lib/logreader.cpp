@@ -2,13 +2,13 @@
 
 CLogReader::Printer CLogReader::Printer::dflt;
 
-inline bool Match( char ch, char pt )
-{
-	return ch == pt || pt == '?';
-}
-
 CLogReader::CLogReader( Handler* hdlr ) : handler(hdlr)
 {
+	for( size_t i = 0; i < WORKERS; ++i )
+	{
+		workers[i].index = i;
+		workers[i].limit = &limit;
+	}
 }
 
 CLogReader::CLogReader() : CLogReader( &Printer::dflt )
@@ -17,152 +17,168 @@ CLogReader::CLogReader() : CLogReader( &Printer::dflt )
 
 CLogReader::~CLogReader()
 {
-	delete[] filter;
+	delete context;
 }
 
-// finds a line break in the text around the given position
-const char* SeekLn( const Sequence<char>& text, const char* p )
+size_t CLogReader::Dispatch( const Text& text )
 {
-	assert( text.from <= p && p < text.to );
-	for( auto pb = p; pb != text.from; --pb )
-	{
-		if( *pb == '\n' )
-		{
-			return pb;
-		}
-	}
-
-	for( auto pf = p; pf != text.to; ++pf )
-	{
-		if( *pf == '\n' )
-		{
-			return pf;
-		}
-	}
-
-	return text.to; // not found
-}
-
-size_t CLogReader::Dispatch( const Text& txt )
-{
-	auto text = txt;
 	const auto total = text.length();
 
 	auto n = total <= BLOCK ? 1 : total / BLOCK;
 	n = n <= WORKERS ? n : WORKERS;
+	n = tuner ? tuner->Split(total) : n;
 
-	assert( n > 0 );
-	const auto block = total / n;
+	assert( n > 0 && n <= WORKERS );
 
-	for( int i = 0; i < n - 1; ++i )
-	{
-		const auto p = SeekLn( text, text.from + block );
-		if( p == text.to )
-		{
-			assert( tail.empty() );
-			tail.Append( {text.from, p} );
+	// equal slices at multiples of 64 bytes, every worker takes the lines starting within its slice
+	const auto slice = (total / n + 63) / 64 * 64;
+	assert( n == 1 || slice * (n-1) < total );
 
-			return i;
-		}
+	newlines.Reset(text);
 
-		workers[i].Start( {text.from, p+1}, filter );
-		text.from = p+1;
+	const bool timed = stats || (tuner && !tuner->settled());
+	for( size_t i = 0; i < n; ++i )
+	{
+		const auto from = text.from + slice * i;
 
-		if( text.empty() )
-		{
-			return i;
-		}
+		workers[i].timed = timed;
+		workers[i].Start( text, {from, i == n-1 ? text.to : from + slice}, matcher, newlines );
 	}
 
-	workers[ n-1 ].Start( text, filter );
-
 	return n;
 }
 
-bool CLogReader::SetFilter( const char* fltr )
+bool CLogReader::SetFilter( const char* fltr, unsigned options )
 {
-	delete filter;
-	filter = nullptr;
+	return matcher.Set( fltr, options );
+}
 
-	// check for invalid characters
-	for( auto p = fltr; *p; ++p )
-	{
-		if( *p == '\n' )
-		{
-			return false;
-		}
-	}
+bool CLogReader::SetField( const char* name )
+{
+	return matcher.SetField(name);
+}
 
-	const char* pr = fltr;
-	char* pw = filter = new char[ strlen(fltr)+1 ];
+void CLogReader::SetContext( size_t before, size_t after )
+{
+	delete context;
+	context = before || after ? new Context( before, after, handler, limit ) : nullptr;
+}
 
-	while(true)
-	{
-		// copy all non-wildcard characters as is
-		for( ; *pr != '*' && (*pw = *pr); ++pr, ++pw );
+void CLogReader::SetLimit( const LineLimit& lmt )
+{
+	limit = lmt;
+}
 
-		if( !*pr ) break;
+void CLogReader::SetStats( Stats* sts )
+{
+	stats = sts;
+}
 
-		// go through the wildcards calculating the number of '?'
-		int q = 0;
-		for( ; *pr == '*' || *pr == '?'; ++pr )
-		{
-			if( *pr == '?' )
-			{
-				++q;
-			}
-		}
+void CLogReader::SetTuner( Tuner* tnr )
+{
+	tuner = tnr;
+}
 
-		// put all '?' before the '*'
-		while( q-- ) *pw++ = '?';
-		*pw++ = '*';
+void CLogReader::SetAffinity( const Affinity* afnt )
+{
+	for( auto& worker : workers )
+	{
+		worker.affinity = afnt && afnt->size() ? afnt : nullptr;
+		worker.moved = true;
 	}
-
-	return true;
 }
 
 bool CLogReader::AddSourceBlock( const char* block, const size_t block_size )
 {
 	assert( block && block_size );
-	if( !filter || !block ||  !block_size )
+	if( matcher.empty() || !block || !block_size )
 	{
 		return false;
 	}
 
 	Text text{ block, block + block_size };
 
+	const double started = stats ? Stats::Wall() : 0;
+
+	const auto origin = consumed; // offset of the block in the input
+	consumed += block_size;
+
+	pieces[0] = { text, origin };
+	pieces[1] = { {}, origin - carried };
+
 	// look for the rest of the unprocessed piece left from the previour run
 	if( !tail.empty() )
 	{
-		auto ln = SeekLn( text, text.from );
+		auto ln = static_cast< const char* >( memchr( text.from, '\n', block_size ) );
 
-		if( ln == text.to )
+		if( !ln )
 		{
-			tail.Append( {text.from, ln} );
+			limit.Carry( tail, text );
+			carried += block_size;
+
+			if(stats)
+			{
+				stats->carried += block_size;
+				stats->AddBlock( started, Stats::Wall(), block_size, 0 );
+			}
+
 			return true;
 		}
 
-		tail.Append( {text.from, ln+1} );
+		limit.Carry( tail, {text.from, ln} );
+		tail.Append('\n');
 		text.from = ln+1;
 	}
 
 	Buffer<char> extra( static_cast< Buffer<char>&& >(tail) ); // clear tail before dispatching
 	assert( tail.empty() );
 
-	auto n = Dispatch(text);
+	size_t n;
+	{
+		Stats::Span span( stats, Stats::DISPATCH, text.length() );
+		n = Dispatch(text);
+	}
+
 	assert( n > 0 );
 
 	// synchronously process the extra piece
 	if( !extra.empty() )
 	{
 		const auto& seq = extra.data();
+		Stats::Span span( stats, Stats::TAIL, seq.length() );
+
+		pieces[1].text = seq;
 
 		Results results;
-		[[maybe_unused]] auto p = Process( seq, filter, results );
+		size_t lines;
+		[[maybe_unused]] auto p = Process( seq, matcher, results, &lines, nullptr, limit );
 
 		assert( p == seq.to );
-		if( !results.empty() )
+
+		const auto base = numbered;
+		results.Each( [base]( Line& line ) { line.number += base; } );
+		numbered += lines;
+
+		if(stats)
+		{
+			stats->lines += lines;
+			stats->matches += results.empty() ? 0 : results.begin()->length();
+		}
+
+		if(context)
+		{
+			context->Begin( seq, base + 1 );
+			for( const auto& line : *results.begin() )
+			{
+				context->Match(line);
+			}
+
+			context->End( seq.to, numbered + 1 );
+		}
+		else if( !results.empty() )
 		{
+			results.Each( [this]( Line& line ) { limit.Apply(line); } );
+
 			auto&& seq = *results.begin();
 			assert( seq.length() == 1 );
 
@@ -171,112 +187,208 @@ bool CLogReader::AddSourceBlock( const char* block, const size_t block_size )
 	}
 
 	// wait for the workers to finish and print the results in proper order
-	for( int i = 0; i < n; ++i )
+	if(context)
+	{
+		// the workers process adjacent pieces, so the context may come from any of them
+		// the bits of the slices are read only after their workers finish
+		context->Begin( text, numbered + 1, &newlines );
+	}
+
+	for( size_t i = 0; i < n; ++i )
 	{
 		auto& worker = workers[i];
-		worker.Wait();
+		{
+			Stats::Span span( stats, Stats::WAIT );
+			worker.Wait();
+		}
+
+		assert( worker.rest == worker.text.to || worker.text.to == text.to );
 
-		assert( worker.rest == worker.text.to || i == n-1 );
+		Stats::Span span( stats, Stats::HANDLE );
+		size_t matches = 0;
 
+		// the numbers of the lines of the worker's piece follow the ones of the preceding pieces
+		const auto base = numbered;
+		numbered += worker.lines;
+
+		// the context cuts the lines itself, after finding the following ones
 		auto& results = worker.results;
+		results.Each( [base, this]( Line& line ) { line.number += base; if( !context ) limit.Apply(line); } );
+
 		for( const auto& seq : results )
 		{
-			handler->Handle(seq);
+			matches += seq.length();
+			if(context)
+			{
+				for( const auto& line : seq )
+				{
+					context->Match(line);
+				}
+			}
+			else
+				handler->Handle(seq);
 		}
 
 		results.Clear();
+
+		if(stats)
+		{
+			stats->AddWorker( i, worker.started, worker.finished, worker.cpu, worker.text.length(), worker.lines, matches );
+		}
 	}
 
-	// store the unprocessed piece of the last forker
-	auto& last = workers[ n-1 ];
-	if( last.rest != text.to )
+	if( tuner && workers[0].timed )
 	{
-		tail.Append( {last.rest, text.to} );
+		double delay = 0, busy = 0;
+		for( size_t i = 0; i < n; ++i )
+		{
+			delay += workers[i].started - workers[i].launched;
+			busy += workers[i].finished - workers[i].started;
+		}
+
+		tuner->Record( text.length(), n, Stats::Wall() - workers[0].launched, delay / n, busy / n );
+	}
+
+	// store the unprocessed piece following the last line break
+	const auto ln = newlines.Previous( text.from, text.to );
+	const auto rest = ln ? ln+1 : text.from;
+
+	if(context)
+	{
+		Stats::Span span( stats, Stats::HANDLE );
+		context->End( rest, numbered + 1 );
+	}
+
+	carried = text.to - rest;
+	if(carried)
+	{
+		limit.Carry( tail, {rest, text.to} );
+	}
+
+	{
+		Stats::Span span( stats, Stats::HANDLE );
+		handler->Flush();
+	}
+
+	if(stats)
+	{
+		stats->carried += text.to - rest;
+		stats->AddBlock( started, Stats::Wall(), block_size, n );
 	}
 
 	return true;
 }
 
-const char* CLogReader::Process( const Text& seq, const char* filter, Results& results )
+size_t CLogReader::offset( const Line& line ) const
+{
+	const auto& piece = pieces[ line.from < pieces[0].text.from || line.from >= pieces[0].text.to ];
+	assert( line.from >= piece.text.from && line.from < piece.text.to );
+
+	return piece.offset + (line.from - piece.text.from);
+}
+
+const char* CLogReader::Process( const Text& seq, const ExpressionMatcher& matcher, Results& results, size_t* lines,
+	Newlines::Scanner* scanner, const LineLimit& limit )
 {
 	const char* ps = seq.from; // sliding pointer to the text
 	const char* const end = seq.to;
 
+	const bool seeking = scanner && matcher.seekable();
+
+	size_t count = 0;
 	while( ps != end )
 	{
-		const char* ppx = nullptr; // pointer to the current movable (followind a '*') piece of the filter
-		const char* pp = filter; // sliding pointer to the filter
-
-		const char* const ln = ps; // points to the beggining of the line
-
-		while(true) // goes through a single line
+		if(seeking)
 		{
-			if( *pp == '*' )
-			{
-				ppx = ++pp;
-			}
+			// pass over the lines lacking the literal required by the filter
+			const auto hit = matcher.Seek( {ps, end} );
+			ps = scanner->Skip( ps, hit ? hit : end, count );
 
-			if( !*pp || ps == end || *ps == '\n' )
+			if( !hit )
 			{
 				break;
 			}
+		}
 
-			if(ppx)
-			{
-				// look for the first character of the piece
-				for( ; ps != end && *ps != '\n' && *ps != *pp; ++ps );
+		auto ln = scanner ? scanner->Next( ps, end ) : static_cast< const char* >( memchr( ps, '\n', end - ps ) );
+		if( !ln )
+		{
+			break; // return the unprocessed piece
+		}
 
-				if( ps == end || *ps == '\n' )
-				{
-					break;
-				}
+		++count;
 
-				++ps;
-				++pp;
-			}
+		Text line{ ps, ln };
+		if( limit.Apply(line) && matcher.Match(line) )
+		{
+			results.Push( Line( {ps, ln}, count ) );
+		}
 
-			const auto psx = ps; // store current position
+		ps = ln+1;
+	}
 
+	if(lines)
+	{
+		*lines = count;
+	}
 
-			for( ; ps != end && *ps != '\n' && *pp != '*' && Match( *ps, *pp ); ++ps, ++pp ); // match the rest of the pattern piece
-			if( *pp != '*' && *ps != '\n' )
-			{
-				if(ppx)
-				{
-					// move back
-					pp = ppx;
-					ps = psx;
-				}
-				else
-					break;
-			}
-		}
+	return ps;
+}
 
-		auto match = (ps != end && *ps == '\n' && !*pp) || (ppx && !*ppx);
-		for( ; ps != end && *ps != '\n'; ++ps ); // skip to the end of the line
-		if( ps != end )
-		{
-			if(match)
-			{
-				results.Push( {ln, ps} );
-			}
+size_t CLogReader::Sample( const Text& text, const Text& slice, const ExpressionMatcher& matcher, const LineLimit& limit,
+	Newlines& newlines, size_t& lines, const char*& end )
+{
+	newlines.Reset(slice);
+	Newlines::Scanner scanner( newlines, slice );
 
-			++ps;
-		}
-		else
-			return ln; // return the unprocessed piece
+	const auto piece = scanner.Lines(text);
+
+	Results results;
+	const auto rest = Process( piece, matcher, results, &lines, &scanner, limit );
+
+	size_t matches = 0;
+	for( const auto& seq : results )
+	{
+		matches += seq.length();
 	}
 
-	return end;
+	// the last line of the text without a line break
+	if( rest != piece.to )
+	{
+		Text line{ rest, piece.to };
+
+		++lines;
+		matches += limit.Apply(line) && matcher.Match(line);
+	}
+
+	end = piece.to;
+	return matches;
 }
 
-void CLogReader::Worker::Start( const Text& seq, const char* fltr )
+void CLogReader::Worker::Start( const Text& blck, const Text& slc, const ExpressionMatcher& mtchr, Newlines& nwlns )
 {
-	text = seq;
-	filter = fltr;
+	block = blck;
+	slice = slc;
+	matcher = &mtchr;
+	newlines = &nwlns;
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+
+	if(affinity)
+	{
+		affinity->Pin( attr, index );
+	}
 
-	[[maybe_unused]] auto err = pthread_create( &thread, nullptr, Work, this );
+	if(timed)
+	{
+		launched = Stats::Wall();
+	}
+
+	[[maybe_unused]] auto err = pthread_create( &thread, &attr, Work, this );
 	assert( !err );
+
+	pthread_attr_destroy(&attr);
 }
 
 void CLogReader::Worker::Wait()
@@ -287,11 +399,183 @@ void CLogReader::Worker::Wait()
 void* CLogReader::Worker::Work( void* param )
 {
 	auto ths = reinterpret_cast< Worker* >(param);
-	ths->rest = Process( ths->text, ths->filter, ths->results );
+	if( ths->timed )
+	{
+		ths->started = Stats::Wall();
+		ths->cpu = Stats::Cpu();
+	}
+
+	if( ths->moved )
+	{
+		ths->results.Shrink(); // reallocated on the new CPU
+		ths->moved = false;
+	}
+
+	Newlines::Scanner scanner( *ths->newlines, ths->slice );
+
+	ths->text = scanner.Lines( ths->block );
+	ths->rest = Process( ths->text, *ths->matcher, ths->results, &ths->lines, &scanner, *ths->limit );
+
+	scanner.Complete(); // the bits of the whole block are used after the workers finish
+
+	if( ths->timed )
+	{
+		ths->finished = Stats::Wall();
+		ths->cpu = Stats::Cpu() - ths->cpu;
+	}
 
 	return nullptr;
 }
 
+CLogReader::Context::Context( size_t bfr, size_t aftr, Handler* hdlr, const LineLimit& lmt ) : before(bfr), after(aftr), handler(hdlr),
+	limit(lmt)
+{
+	ring = new Retained[ before ? before : 1 ];
+}
+
+CLogReader::Context::~Context()
+{
+	delete[] ring;
+}
+
+void CLogReader::Context::Begin( const Text& seq, size_t nmbr, const Newlines* nwlns )
+{
+	segment = seq;
+	pos = seq.from;
+	number = nmbr;
+	newlines = nwlns;
+}
+
+const char* CLogReader::Context::Next( const char* p, const char* to ) const
+{
+	return newlines ? newlines->Next( p, to ) : static_cast< const char* >( memchr( p, '\n', to - p ) );
+}
+
+const char* CLogReader::Context::Start( const char* from, const char* p ) const
+{
+	if( !newlines )
+	{
+		for( --p; p != from && p[-1] != '\n'; --p );
+		return p;
+	}
+
+	auto ln = newlines->Previous( from, p-1 );
+	return ln ? ln+1 : from;
+}
+
+void CLogReader::Context::Match( const Line& line )
+{
+	assert( pos <= line.from && line.to < segment.to );
+
+	// the after-context of the previous matching lines
+	for( ; pending && pos != line.from; --pending )
+	{
+		auto ln = Next( pos, line.from );
+
+		Emit( Line( {pos, ln}, number++ ), false );
+		pos = ln+1;
+	}
+
+	// look back for the before-context not emitted yet
+	auto from = line.from;
+	size_t n = 0;
+
+	for( ; n < before && from != pos; ++n )
+	{
+		from = Start( pos, from );
+	}
+
+	// take the rest from the lines retained from the previous segments
+	if( n < before && from == segment.from )
+	{
+		auto k = size < before - n ? size : before - n;
+		for( auto i = size - k; i < size; ++i )
+		{
+			auto& retained = ring[ (first + i) % before ];
+			if( retained.number >= last )
+			{
+				Emit( Line( retained.line.data(), retained.number ), false );
+			}
+		}
+	}
+
+	for( auto nmbr = line.number - n; from != line.from; ++nmbr )
+	{
+		auto ln = Next( from, line.from );
+
+		Emit( Line( {from, ln}, nmbr ), false );
+		from = ln+1;
+	}
+
+	Emit( line, true );
+
+	pos = line.to + 1;
+	number = line.number + 1;
+	pending = after;
+}
+
+void CLogReader::Context::End( const char* to, size_t next )
+{
+	segment.to = to;
+
+	for( ; pending && pos != segment.to; --pending )
+	{
+		auto ln = Next( pos, segment.to );
+
+		Emit( Line( {pos, ln}, number++ ), false );
+		pos = ln+1;
+	}
+
+	if( !before )
+	{
+		return;
+	}
+
+	// retain the last lines of the segment
+	auto from = segment.to;
+	size_t n = 0;
+
+	for( ; n < before && from != segment.from; ++n )
+	{
+		from = Start( segment.from, from );
+	}
+
+	// drop the oldest ones to make room for the new
+	const auto excess = size + n > before ? size + n - before : 0;
+	first = (first + excess) % before;
+	size -= excess;
+
+	for( auto nmbr = next - n; from != segment.to; ++nmbr )
+	{
+		auto ln = Next( from, segment.to );
+
+		Text line{ from, ln };
+		limit.Apply(line);
+
+		auto& retained = ring[ (first + size++) % before ];
+		retained.line.Clear();
+		retained.line.Append(line);
+		retained.number = nmbr;
+
+		from = ln+1;
+	}
+}
+
+void CLogReader::Context::Emit( Line line, bool match )
+{
+	if( last && line.number != last )
+	{
+		handler->Break();
+	}
+
+	limit.Apply(line);
+
+	const Sequence<Line> lines{ &line, &line + 1 };
+	match ? handler->Handle(lines) : handler->HandleContext(lines);
+
+	last = line.number + 1;
+}
+
 CLogReader::Printer::Printer() : file(stdout)
 {
 }
@@ -310,9 +594,29 @@ CLogReader::Printer::~Printer()
 }
 
 void CLogReader::Printer::Handle( const Sequence<Line>& lines )
+{
+	Print( lines, ':' );
+}
+
+void CLogReader::Printer::HandleContext( const Sequence<Line>& lines )
+{
+	Print( lines, '-' );
+}
+
+void CLogReader::Printer::Break()
+{
+	fputs( "--\n", file );
+}
+
+void CLogReader::Printer::Print( const Sequence<Line>& lines, char separator )
 {
 	for( const auto& line : lines )
 	{
+		if(numbers)
+		{
+			fprintf( file, "%zu%c", line.number, separator );
+		}
+
 		fwrite( line.from, 1, line.length(), file );
 		fputc( '\n', file );
 	}
@@ -1,19 +1,35 @@
 #ifndef __LOGREADER_HEADER__
 #define __LOGREADER_HEADER__
 
+#include "affinity.h"
 #include "basic.h"
 #include "deque.h"
+#include "expression.h"
+#include "newlines.h"
+#include "stats.h"
+#include "tuner.h"
 
 #include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 
 class CLogReader
 {
+public:
 	static constexpr size_t WORKERS = 4; // maximum workers number
-	static constexpr size_t BLOCK = 256 * 1024; // minimal block size per worker
+	static constexpr size_t BLOCK = 256 * 1024; // minimal block size per worker, unless tuned
+
+	// a line of the input with its number, starting from 1
+	struct Line : Sequence<char>
+	{
+		Line() = default;
+		Line( const Sequence<char>& text, size_t nmbr ) : Sequence<char>(text), number(nmbr) {}
 
+		size_t number;
+	};
+
+private:
 	using Text = Sequence<char>;
-	using Line = Sequence<char>;
 
 public:
 	struct Handler;
@@ -23,14 +39,40 @@ public:
 	CLogReader(); // uses the default printer
 	~CLogReader();
 
-	bool SetFilter( const char* );
+	bool SetFilter( const char*, unsigned options = 0 ); // options are a combination of Filter flags
+	bool SetField( const char* ); // matches the filter against the value of the field, see Field
+	void SetContext( size_t before, size_t after ); // number of the context lines around every matching one
+	void SetStats( Stats* ); // collects the performance statistics, nullptr to stop
+	void SetAffinity( const Affinity* ); // pins the workers to the CPUs, nullptr to stop
+	void SetTuner( Tuner* ); // splits the blocks among the workers as tuned, nullptr for the fixed split
+
+	// a longer line is matched and passed to the handler by its first bytes, or passed over but counted,
+	// a context line is cut in either case
+	void SetLimit( const LineLimit& );
+
 	bool AddSourceBlock( const char*, const size_t );
 
+	// the offset in the input of a line passed to Handle, while it is handled
+	size_t offset( const Line& ) const;
+
+	// matches the lines of the text starting within the slice of it as a worker does, for sampling the text;
+	// returns the number of the matching ones, sets the number of all of them and the end of the last one
+	static size_t Sample( const Text& text, const Text& slice, const ExpressionMatcher&, const LineLimit&, Newlines&,
+		size_t& lines, const char*& end );
+
 private:
+	friend struct Probe; // gives the benchmarks access to the internals
+
 	using Results = Deque< Line, 128 >;
 
+	struct Context;
+
 	// returns a pointer to unprocessed trailing piece
-	static const char* Process( const Text&, const char* filter, Results& );
+	// the results are numbered from 1 within the text, counts the scanned lines if asked
+	// the line breaks are found by the scanner if given
+	// a line over the limit is matched by its beginning but kept whole in the results, to be cut when passed on
+	static const char* Process( const Text&, const ExpressionMatcher&, Results&, size_t* lines = nullptr, Newlines::Scanner* = nullptr,
+		const LineLimit& = LineLimit() );
 
 	// distributes work among the workers
 	// returns the number of workers involved
@@ -38,33 +80,122 @@ private:
 
 	struct Worker
 	{
-		void Start( const Text&, const char* filter ); // starts asynchronous work
+		void Start( const Text& block, const Text& slice, const ExpressionMatcher&, Newlines& ); // starts asynchronous work
 		void Wait(); // waits until finishes
 
-		Results results;
+		Results results; // allocated and retained by the worker thread, so it stays local to a pinned one
 		const char* rest; // points to end of the processed piece
 
 		static void* Work( void* param ); // thread func
 
-		const char* filter;
-		Text text;
+		const Affinity* affinity = nullptr;
+		size_t index;
+		bool moved = false; // the results were allocated elsewhere
+
+		const ExpressionMatcher* matcher;
+		const LineLimit* limit;
+		Newlines* newlines;
+
+		Text block, slice; // the worker builds the bits of the slice of the block
+		Text text; // the lines starting within the slice, set by the worker
 
 		pthread_t thread;
+
+		// measured only with the stats or while tuning
+		bool timed = false;
+		double launched, started, finished, cpu;
+		size_t lines;
 	};
 
+	static_assert( WORKERS <= Stats::WORKERS, "the stats are to cover every worker" );
+
 	Worker workers[WORKERS];
 
 	Handler* handler;
 
-	char* filter = nullptr;
+	ExpressionMatcher matcher;
+
+	Newlines newlines; // of the block passed to the workers
 
-	Buffer<char> tail; // holds unprocessed piece from the previous
+	Context* context = nullptr;
+
+	LineLimit limit;
+
+	Stats* stats = nullptr;
+	Tuner* tuner = nullptr;
+
+	Buffer<char> tail; // holds unprocessed piece from the previous, up to the limit
+	size_t carried = 0; // size of the piece in the input
+	size_t consumed = 0; // total size of the input
+	size_t numbered = 0; // number of the lines processed
+
+	// the block and the line carried into it whose lines are handled, with their offsets in the input
+	struct Piece
+	{
+		Text text;
+		size_t offset;
+	};
+
+	Piece pieces[2] = {};
 };
 
 struct CLogReader::Handler
 {
-	using Line = Sequence<char>;
+	using Line = CLogReader::Line;
+	virtual ~Handler() = default;
+
 	virtual void Handle( const Sequence<Line>& ) = 0;
+
+	virtual void HandleContext( const Sequence<Line>& ) {} // lines around the matching ones
+	virtual void Break() {} // a gap between groups of the matching and context lines
+
+	// the end of a block, the lines passed since the previous call remain valid until it returns
+	virtual void Flush() {}
+};
+
+// gathers the context lines in the ordered merge of the matching ones
+// the lines preceding the current segment of the input are retained in a ring
+struct CLogReader::Context
+{
+	Context( size_t before, size_t after, Handler*, const LineLimit& );
+	~Context();
+
+	// starts a piece of complete lines, the number is of its first line
+	// the line breaks are looked up in the bitmap if given
+	void Begin( const Text& segment, size_t number, const Newlines* = nullptr );
+	void Match( const Line& ); // emits a matching line of the segment with its context
+
+	// emits the after-context up to the end of the segment's complete lines and retains the last ones
+	// the number is of the line following them
+	void End( const char* to, size_t number );
+
+private:
+	void Emit( Line, bool match ); // cut to the limit
+
+	const char* Next( const char* p, const char* to ) const; // the first line break in [p, to)
+	const char* Start( const char* from, const char* p ) const; // the beginning of the line ending right before p
+
+	const Newlines* newlines = nullptr;
+
+	struct Retained
+	{
+		Buffer<char> line; // cut to the limit
+		size_t number;
+	};
+
+	const size_t before, after;
+	Handler* const handler;
+	const LineLimit& limit;
+
+	Retained* ring; // the last 'before' lines preceding the segment
+	size_t first = 0, size = 0;
+
+	Text segment;
+	const char* pos; // the first line of the segment not passed yet
+	size_t number; // of the line at pos
+
+	size_t pending = 0; // number of the after-context lines to emit
+	size_t last = 0; // number of the line following the last emitted one, 0 if none
 };
 
 struct CLogReader::Printer : public Handler
@@ -75,10 +206,16 @@ public:
 	~Printer();
 
 	void Handle( const Sequence<Line>& ) override;
+	void HandleContext( const Sequence<Line>& ) override;
+	void Break() override;
 
 	static Printer dflt;
 
+	bool numbers = false; // prefixes the lines with their numbers like grep -n
+
 private:
+	void Print( const Sequence<Line>&, char separator ); // of the number and the line
+
 	FILE* file;
 };
 
@@ -0,0 +1,545 @@
+#ifndef __MATCHER_HEADER__
+#define __MATCHER_HEADER__
+
+#include "basic.h"
+#include "simd.h"
+
+#include <stddef.h>
+#include <string.h>
+
+// Matchers test a single line (without the line break) against a filter.
+// Every matcher provides
+//   bool Set( const char* filter, unsigned options = 0 ); // returns false if the filter is invalid or does not fit the matcher
+//   bool Match( const Sequence<char>& line ) const;
+// and optionally
+//   bool seekable() const; // the filter has a literal which every matching line contains
+//   const char* Seek( const Sequence<char>& text ) const; // the first occurrence of the literal in the text, nullptr if none
+// so the lines without it can be passed over without matching them one by one.
+// WildcardMatcher handles any filter, the others are specialized for a particular filter shape.
+
+// filter options
+struct Filter
+{
+	enum : unsigned
+	{
+		EXPRESSION = 1 << 0, // a boolean expression of filters, see ExpressionMatcher
+		ICASE = 1 << 1, // ASCII letters match regardless of their case
+		UTF8 = 1 << 2, // '?' matches a UTF-8 encoded character instead of a byte, the filter is to be valid UTF-8, see WildcardMatcher
+	};
+};
+
+// for the case-insensitive matching the filter is folded to lower case once, and every letter
+// of it gets a 0x20 mask to OR the text bytes with, so 'A' | 0x20 == 'a' while the other bytes are compared as is
+inline char Fold( char ch )
+{
+	return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') ? 0x20 : 0;
+}
+
+// folds the filter in place and fills the masks, returns the filter length
+inline size_t Fold( char* filter, char* masks, bool icase )
+{
+	size_t i = 0;
+	for( ; filter[i]; ++i )
+	{
+		masks[i] = icase ? Fold( filter[i] ) : 0;
+		filter[i] |= masks[i];
+	}
+
+	return i;
+}
+
+enum class Shape
+{
+	EXACT, // "abc"
+	PREFIX, // "abc*"
+	SUFFIX, // "*abc"
+	SUBSTRING, // "*abc*"
+	GENERAL, // anything else
+};
+
+// tells if the text is valid UTF-8: every lead byte is followed by as many continuation bytes as it announces
+inline bool Utf8( const char* text )
+{
+	for( auto p = reinterpret_cast< const unsigned char* >(text); *p; )
+	{
+		const unsigned lead = *p++;
+		if( lead < 0x80 )
+		{
+			continue;
+		}
+
+		// a stray continuation byte, an overlong or out of range lead
+		if( lead < 0xC2 || lead > 0xF4 )
+		{
+			return false;
+		}
+
+		for( int n = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : 1; n--; ++p )
+		{
+			if( (*p & 0xC0) != 0x80 )
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+// returns a normalized copy of the filter allocated with new[] where a sequence of wildcards
+// is represented by all of its '?' followed by a single '*'
+// returns nullptr if the filter is invalid
+inline char* Normalize( const char* fltr, unsigned options = 0 )
+{
+	// check for invalid characters
+	for( auto p = fltr; *p; ++p )
+	{
+		if( *p == '\n' )
+		{
+			return nullptr;
+		}
+	}
+
+	// in the UTF-8 mode a '*' ends at a character while the literal following it is looked for by the bytes,
+	// so a stray continuation byte of the filter could match inside a character
+	if( options & Filter::UTF8 && !Utf8(fltr) )
+	{
+		return nullptr;
+	}
+
+	const char* pr = fltr;
+	char* const filter = new char[ strlen(fltr)+1 ];
+	char* pw = filter;
+
+	while(true)
+	{
+		// copy all non-wildcard characters as is
+		for( ; *pr != '*' && (*pw = *pr); ++pr, ++pw );
+
+		if( !*pr ) break;
+
+		// go through the wildcards calculating the number of '?'
+		int q = 0;
+		for( ; *pr == '*' || *pr == '?'; ++pr )
+		{
+			if( *pr == '?' )
+			{
+				++q;
+			}
+		}
+
+		// put all '?' before the '*'
+		while( q-- ) *pw++ = '?';
+		*pw++ = '*';
+	}
+
+	return filter;
+}
+
+// detects the shape of a normalized filter
+inline Shape Detect( const char* filter )
+{
+	const auto len = strlen(filter);
+
+	const bool head = len > 0 && filter[0] == '*';
+	const bool trail = len > 1 && filter[ len-1 ] == '*';
+
+	// the literal part between the optional leading and trailing '*'
+	const char* from = filter + head;
+	const char* to = filter + len - trail;
+
+	for( auto p = from; p < to; ++p )
+	{
+		if( *p == '*' || *p == '?' )
+		{
+			return Shape::GENERAL;
+		}
+	}
+
+	if( head && trail ) return Shape::SUBSTRING;
+	if(head) return Shape::SUFFIX;
+	if(trail) return Shape::PREFIX;
+
+	return Shape::EXACT;
+}
+
+// compares n characters at p with the literal, masks are those of the literal, nullptr if case-sensitive
+inline bool Equal( const char* p, const char* literal, const char* masks, size_t n )
+{
+	if( !masks )
+	{
+		return memcmp( p, literal, n ) == 0;
+	}
+
+	for( size_t i = 0; i < n; ++i )
+	{
+		if( char( p[i] | masks[i] ) != literal[i] )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// matches a line against a literal of the given shape, see LiteralMatcher
+template< Shape SHAPE >
+inline bool MatchLiteral( const Sequence<char>& line, const char* literal, const char* masks, size_t length )
+{
+	if( line.length() < length )
+	{
+		return false;
+	}
+
+	switch(SHAPE)
+	{
+	case Shape::EXACT:
+		return line.length() == length && Equal( line.from, literal, masks, length );
+
+	case Shape::PREFIX:
+		return Equal( line.from, literal, masks, length );
+
+	case Shape::SUFFIX:
+		return Equal( line.to - length, literal, masks, length );
+
+	case Shape::SUBSTRING:
+		if( !length )
+		{
+			return true;
+		}
+
+		// look for the first character, then compare the rest
+		for( auto p = line.from, last = line.to - length + 1; p != last; ++p )
+		{
+			p = Find( p, last, *literal, masks ? *masks : 0 );
+			if( !p )
+			{
+				return false;
+			}
+
+			if( Equal( p+1, literal+1, masks ? masks+1 : nullptr, length-1 ) )
+			{
+				return true;
+			}
+		}
+
+		return false;
+
+	default:
+		return false;
+	}
+}
+
+// In the UTF-8 mode a '?' takes a lead byte with its continuation bytes; an ASCII line, which is told
+// by a vector check, is matched by the bytes as usual, as is a filter without '?'.
+// A malformed sequence of the line is taken byte by byte, the filter is rejected.
+// A filter of a literal shape, e.g. "*abc*", is matched without the scan as by LiteralMatcher.
+class WildcardMatcher
+{
+public:
+	using Line = Sequence<char>;
+
+	static constexpr size_t CAPTURES = 16; // maximum number of the captured '*'
+
+	WildcardMatcher() = default;
+	WildcardMatcher( const WildcardMatcher& ) = delete;
+	~WildcardMatcher() { delete[] filter; delete[] masks; }
+
+	WildcardMatcher& operator=( const WildcardMatcher& ) = delete;
+
+	bool Set( const char*, unsigned options = 0 );
+
+	bool Match( const Line& ) const;
+
+	// also stores the text matched by each of the first CAPTURES '*' of the filter
+	bool Match( const Line& line, Line* captures ) const
+	{
+		return utf8 && !Ascii( line.from, line.to ) ? Scan< true, true >( line, captures ) : Scan<true>( line, captures );
+	}
+
+	size_t captures() const { return stars < CAPTURES ? stars : CAPTURES; }
+
+	// the longest literal piece of the filter
+	bool seekable() const { return length; }
+	const char* Seek( const Line& ) const;
+
+	bool empty() const { return !filter; }
+
+private:
+	static bool Match( char ch, char pt, char mask ) { return char( ch | mask ) == pt || pt == '?'; }
+
+	// the position following the character at p matched by pt
+	template< bool UTF8 >
+	static const char* Next( const char* p, const char* end, char pt );
+
+	template< bool CAPTURE, bool UTF8 = false >
+	bool Scan( const Line&, Line* captures ) const;
+
+	// matches a filter of a literal shape, which is the longest literal piece
+	template< Shape SHAPE >
+	bool Literal( const Line& line ) const { return MatchLiteral<SHAPE>( line, filter + key, icase ? masks + key : nullptr, length ); }
+
+	char* filter = nullptr;
+	char* masks = nullptr; // case folding masks of the filter characters
+	size_t stars = 0; // number of '*' in the filter
+	bool utf8 = false; // the UTF-8 mode with a '?' in the filter
+	bool icase = false;
+	Shape shape = Shape::GENERAL; // a literal shape is matched as by LiteralMatcher
+
+	size_t key = 0, length = 0; // the longest literal piece of the filter
+};
+
+// a literal filter, optionally anchored at the beginning and/or the end of a line
+template< Shape SHAPE >
+class LiteralMatcher
+{
+public:
+	using Line = Sequence<char>;
+
+	LiteralMatcher() = default;
+	LiteralMatcher( const LiteralMatcher& ) = delete;
+	~LiteralMatcher() { delete[] literal; delete[] masks; }
+
+	LiteralMatcher& operator=( const LiteralMatcher& ) = delete;
+
+	bool Set( const char*, unsigned options = 0 );
+	bool Match( const Line& line ) const { return MatchLiteral<SHAPE>( line, literal, masks, length ); }
+
+	bool empty() const { return !literal; }
+
+private:
+	char* literal = nullptr;
+	char* masks = nullptr; // case folding masks of the literal, nullptr if case-sensitive
+	size_t length = 0;
+};
+
+using ExactMatcher = LiteralMatcher< Shape::EXACT >;
+using PrefixMatcher = LiteralMatcher< Shape::PREFIX >;
+using SuffixMatcher = LiteralMatcher< Shape::SUFFIX >;
+using SubstringMatcher = LiteralMatcher< Shape::SUBSTRING >;
+
+inline bool WildcardMatcher::Set( const char* fltr, unsigned options )
+{
+	delete[] filter;
+	delete[] masks;
+	masks = nullptr;
+
+	if( options & Filter::EXPRESSION || !(filter = Normalize( fltr, options )) )
+	{
+		filter = nullptr;
+		return false;
+	}
+
+	masks = new char[ strlen(filter)+1 ];
+	Fold( filter, masks, options & Filter::ICASE );
+
+	stars = 0;
+	key = length = 0;
+	utf8 = false;
+	icase = options & Filter::ICASE;
+	shape = Detect(filter);
+
+	for( size_t i = 0, from = 0; ; ++i )
+	{
+		const char ch = filter[i];
+		if( ch && ch != '*' && ch != '?' )
+		{
+			continue;
+		}
+
+		if( i - from > length )
+		{
+			key = from;
+			length = i - from;
+		}
+
+		if( !ch )
+		{
+			break;
+		}
+
+		stars += ch == '*';
+		utf8 |= ch == '?' && options & Filter::UTF8;
+		from = i+1;
+	}
+
+	return true;
+}
+
+inline bool WildcardMatcher::Match( const Line& line ) const
+{
+	switch(shape)
+	{
+	case Shape::EXACT: return Literal< Shape::EXACT >(line);
+	case Shape::PREFIX: return Literal< Shape::PREFIX >(line);
+	case Shape::SUFFIX: return Literal< Shape::SUFFIX >(line);
+	case Shape::SUBSTRING: return Literal< Shape::SUBSTRING >(line);
+	default: break;
+	}
+
+	return utf8 && !Ascii( line.from, line.to ) ? Scan< false, true >( line, nullptr ) : Scan<false>( line, nullptr );
+}
+
+inline const char* WildcardMatcher::Seek( const Line& text ) const
+{
+	if( text.length() < length )
+	{
+		return nullptr;
+	}
+
+	const char* const literal = filter + key;
+	const char* const mask = masks + key;
+
+	// look for the first character, then compare the rest
+	for( auto p = text.from, last = text.to - length + 1; p != last; ++p )
+	{
+		p = Find( p, last, *literal, *mask );
+		if( !p )
+		{
+			return nullptr;
+		}
+
+		size_t i = 1;
+		for( ; i < length && char( p[i] | mask[i] ) == literal[i]; ++i );
+
+		if( i == length )
+		{
+			return p;
+		}
+	}
+
+	return nullptr;
+}
+
+template< bool UTF8 >
+inline const char* WildcardMatcher::Next( const char* p, const char* end, char pt )
+{
+	const auto lead = static_cast< unsigned char >(*p++);
+	if( !UTF8 || pt != '?' || lead < 0xC0 )
+	{
+		return p;
+	}
+
+	// the continuation bytes the lead byte announces, as many as there are
+	for( int n = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : 1; n-- && p != end && (*p & 0xC0) == 0x80; ++p );
+	return p;
+}
+
+template< bool CAPTURE, bool UTF8 >
+inline bool WildcardMatcher::Scan( const Line& line, Line* captures ) const
+{
+	const char* ps = line.from; // sliding pointer to the text
+	const char* const end = line.to;
+
+	const char* ppx = nullptr; // pointer to the current movable (following a '*') piece of the filter
+	const char* pp = filter; // sliding pointer to the filter
+	const ptrdiff_t mask = masks - filter; // pp[mask] is the case folding mask of *pp
+
+	Line* capture = nullptr; // the capture of the current '*'
+	Line* const last = CAPTURE ? captures + CAPTURES : nullptr;
+
+	while(true)
+	{
+		if( *pp == '*' )
+		{
+			ppx = ++pp;
+
+			if( CAPTURE )
+			{
+				capture = !capture ? captures : capture < last ? capture+1 : last;
+				if( capture < last )
+				{
+					capture->from = capture->to = ps;
+				}
+			}
+		}
+
+		if( !*pp || ps == end )
+		{
+			break;
+		}
+
+		if(ppx)
+		{
+			// look for the first character of the piece
+			ps = Find( ps, end, *pp, pp[mask] );
+			if( !ps )
+			{
+				return false;
+			}
+
+			if( CAPTURE && capture < last )
+			{
+				capture->to = ps;
+			}
+
+			++ps;
+			++pp;
+		}
+
+		const auto psx = ps; // store current position
+
+		for( ; ps != end && *pp && *pp != '*' && Match( *ps, *pp, pp[mask] ); ps = Next<UTF8>( ps, end, *pp ), ++pp ); // match the rest of the pattern piece
+		if( *pp != '*' && ps != end )
+		{
+			if( !ppx )
+			{
+				return false;
+			}
+
+			// move back
+			pp = ppx;
+			ps = psx;
+		}
+	}
+
+	if( ppx && !*ppx )
+	{
+		// the filter ends with a '*' which takes the rest of the line
+		if( CAPTURE && capture < last )
+		{
+			capture->to = end;
+		}
+
+		return true;
+	}
+
+	return ps == end && !*pp;
+}
+
+template< Shape SHAPE >
+inline bool LiteralMatcher< SHAPE >::Set( const char* fltr, unsigned options )
+{
+	delete[] literal;
+	literal = nullptr;
+
+	delete[] masks;
+	masks = nullptr;
+
+	auto filter = options & Filter::EXPRESSION ? nullptr : Normalize( fltr, options );
+	if( !filter || Detect(filter) != SHAPE )
+	{
+		delete[] filter;
+		return false;
+	}
+
+	const bool head = SHAPE == Shape::SUFFIX || SHAPE == Shape::SUBSTRING;
+	const bool trail = SHAPE == Shape::PREFIX || SHAPE == Shape::SUBSTRING;
+
+	length = strlen(filter) - head - trail;
+
+	literal = new char[ length+1 ];
+	memcpy( literal, filter + head, length );
+	literal[length] = '\0';
+
+	if( options & Filter::ICASE )
+	{
+		masks = new char[ length+1 ];
+		Fold( literal, masks, true );
+	}
+
+	delete[] filter;
+	return true;
+}
+
+#endif // !__MATCHER_HEADER__
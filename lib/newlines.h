@@ -0,0 +1,311 @@
+#ifndef __NEWLINES_HEADER__
+#define __NEWLINES_HEADER__
+
+#include "basic.h"
+#include "simd.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// A bitmap of the line breaks of a text, a bit per byte in 64-bit words.
+// The bits are computed once per block by the vector kernel, 64 bytes at a time, and every stage finds
+// the line breaks with bit scans instead of searching the bytes again: the workers build the bits of their
+// slices of the block and find the ends of the lines in them, then the calling thread finds the unterminated
+// tail and the context lines in the complete bitmap.
+class Newlines
+{
+public:
+	using Text = Sequence<char>;
+
+	Newlines() = default;
+	Newlines( const Newlines& ) = delete;
+	~Newlines() { delete[] words; }
+
+	Newlines& operator=( const Newlines& ) = delete;
+
+	void Reset( const Text& ); // for a new text, the bits are built later
+
+	// computes the bits of the bytes, the range starts at a multiple of 64 from the beginning of the text
+	// and ends at one too or at the end; disjoint ranges can be built in parallel
+	void Build( const char* from, const char* to );
+
+	// the bits of the range must be built
+	const char* Next( const char* p, const char* to ) const; // the first line break in [p, to), to if none
+	const char* Previous( const char* from, const char* p ) const; // the last line break in [from, p), nullptr if none
+	size_t Count( const char* from, const char* to ) const; // the number of the line breaks in [from, to)
+
+	const Text& text() const { return txt; }
+
+	class Scanner;
+
+private:
+	Text txt;
+
+	uint64_t* words = nullptr;
+	size_t capacity = 0; // in words
+};
+
+// finds the line breaks of a slice of the text in order, building the bits of the slice chunk by chunk
+// just ahead, so the bytes are still in the cache when the lines are matched; the line breaks following
+// the slice are searched for in the bytes, as the bits of the next slice belong to another worker
+class Newlines::Scanner
+{
+public:
+	static constexpr size_t CHUNK = 16 * 1024; // built at once
+
+	Scanner( Newlines&, const Text& slice );
+
+	// the lines of the text starting within the slice, the last one may end in the following slices
+	Text Lines( const Text& text );
+
+	const char* Next( const char* p, const char* end ); // the first line break in [p, end), nullptr if none
+
+	// passes the lines ending before q, returns the beginning of the line containing q and adds the number of them
+	const char* Skip( const char* p, const char* q, size_t& count );
+
+	void Complete(); // builds the rest of the slice
+
+private:
+	void Extend(); // builds the next chunk
+
+	Newlines& newlines;
+	const Text slice;
+	const char* built; // the end of the bits built
+
+	const char* next = nullptr; // following the last line break found in the bits
+	size_t word = 0; // the index of its word
+	uint64_t bits = 0; // the bits of the word following it
+};
+
+inline void Newlines::Reset( const Text& text )
+{
+	txt = text;
+
+	const auto n = (text.length() + 63) / 64;
+	if( n > capacity )
+	{
+		delete[] words;
+		words = new uint64_t[n];
+		capacity = n;
+	}
+}
+
+inline void Newlines::Build( const char* from, const char* to )
+{
+	assert( txt.from <= from && from <= to && to <= txt.to && (from == to || !((from - txt.from) % 64)) );
+
+	auto word = words + (from - txt.from) / 64;
+	for( ; to - from >= 64; from += 64 )
+	{
+		*word++ = Bits( from, '\n' );
+	}
+
+	if( from != to )
+	{
+		// the end of the text, padded
+		char last[64] = {};
+		memcpy( last, from, to - from );
+
+		*word = Bits( last, '\n' ) & ((uint64_t(1) << (to - from)) - 1);
+	}
+}
+
+inline const char* Newlines::Next( const char* p, const char* to ) const
+{
+	if( p == to )
+	{
+		return to;
+	}
+
+	const size_t first = p - txt.from, last = to - txt.from - 1;
+
+	auto i = first / 64;
+	auto bits = words[i] & (~uint64_t(0) << (first % 64));
+
+	for( ;; )
+	{
+		if( i == last / 64 )
+		{
+			bits &= ~uint64_t(0) >> (63 - last % 64);
+			return bits ? txt.from + i * 64 + __builtin_ctzll(bits) : to;
+		}
+
+		if(bits)
+		{
+			return txt.from + i * 64 + __builtin_ctzll(bits);
+		}
+
+		bits = words[ ++i ];
+	}
+}
+
+inline const char* Newlines::Previous( const char* from, const char* p ) const
+{
+	if( from == p )
+	{
+		return nullptr;
+	}
+
+	const size_t first = from - txt.from, last = p - txt.from - 1;
+
+	auto i = last / 64;
+	auto bits = words[i] & (~uint64_t(0) >> (63 - last % 64));
+
+	for( ;; )
+	{
+		if( i == first / 64 )
+		{
+			bits &= ~uint64_t(0) << (first % 64);
+			return bits ? txt.from + i * 64 + 63 - __builtin_clzll(bits) : nullptr;
+		}
+
+		if(bits)
+		{
+			return txt.from + i * 64 + 63 - __builtin_clzll(bits);
+		}
+
+		bits = words[ --i ];
+	}
+}
+
+inline size_t Newlines::Count( const char* from, const char* to ) const
+{
+	if( from == to )
+	{
+		return 0;
+	}
+
+	const size_t first = from - txt.from, last = to - txt.from - 1;
+
+	auto i = first / 64;
+	auto bits = words[i] & (~uint64_t(0) << (first % 64));
+
+	size_t count = 0;
+	for( ; i != last / 64; bits = words[ ++i ] )
+	{
+		count += __builtin_popcountll(bits);
+	}
+
+	return count + __builtin_popcountll( bits & (~uint64_t(0) >> (63 - last % 64)) );
+}
+
+inline Newlines::Scanner::Scanner( Newlines& nwlns, const Text& slc ) : newlines(nwlns), slice(slc), built( slc.from )
+{
+}
+
+inline Newlines::Text Newlines::Scanner::Lines( const Text& text )
+{
+	auto from = slice.from;
+	if( from != text.from && from[-1] != '\n' )
+	{
+		auto ln = Next( from, slice.to );
+		from = ln ? ln+1 : slice.to;
+	}
+
+	if( from == slice.to )
+	{
+		return { from, from }; // no line starts within the slice
+	}
+
+	auto to = slice.to;
+	if( to != text.to && to[-1] != '\n' )
+	{
+		auto ln = static_cast< const char* >( memchr( to, '\n', text.to - to ) );
+		to = ln ? ln+1 : text.to;
+	}
+
+	return { from, to };
+}
+
+inline const char* Newlines::Scanner::Next( const char* p, const char* end )
+{
+	if( p < slice.to )
+	{
+		assert( slice.from <= p );
+
+		const auto base = newlines.txt.from;
+		const size_t limit = slice.to - base;
+
+		// the lines are usually passed in order, then the bits following the last line break are at hand
+		if( p != next )
+		{
+			const size_t offset = p - base;
+			while( built <= p )
+			{
+				Extend();
+			}
+
+			word = offset / 64;
+			bits = newlines.words[word] & (~uint64_t(0) << (offset % 64));
+		}
+
+		for( ; !bits && (word + 1) * 64 < limit; bits = newlines.words[ ++word ] )
+		{
+			if( (word + 1) * 64 >= size_t( built - base ) )
+			{
+				Extend();
+			}
+		}
+
+		if(bits)
+		{
+			const auto ln = base + word * 64 + __builtin_ctzll(bits);
+			bits &= bits - 1;
+			next = ln + 1;
+
+			return ln < end ? ln : nullptr;
+		}
+
+		p = slice.to;
+	}
+
+	next = nullptr;
+	return p < end ? static_cast< const char* >( memchr( p, '\n', end - p ) ) : nullptr;
+}
+
+inline const char* Newlines::Scanner::Skip( const char* p, const char* q, size_t& count )
+{
+	const auto start = p;
+	const char* ln = nullptr; // the last line break passed
+
+	next = nullptr; // the lines are no longer passed in order
+
+	if( p < slice.to )
+	{
+		const auto to = q < slice.to ? q : slice.to;
+		while( built < to )
+		{
+			Extend();
+		}
+
+		count += newlines.Count( p, to );
+		ln = newlines.Previous( p, to );
+
+		p = to;
+	}
+
+	// following the slice
+	for( const char* br; p != q && (br = static_cast< const char* >( memchr( p, '\n', q - p ) )); p = br+1 )
+	{
+		++count;
+		ln = br;
+	}
+
+	return ln ? ln+1 : start;
+}
+
+inline void Newlines::Scanner::Extend()
+{
+	const auto to = size_t( slice.to - built ) > CHUNK ? built + CHUNK : slice.to;
+
+	newlines.Build( built, to );
+	built = to;
+}
+
+inline void Newlines::Scanner::Complete()
+{
+	newlines.Build( built, slice.to );
+	built = slice.to;
+}
+
+#endif // !__NEWLINES_HEADER__
@@ -0,0 +1,96 @@
+#include "offsets.h"
+
+#include <string.h>
+
+Offsets::Writer::Writer( FILE* fl, bool nmbrs ) : file(fl), numbers(nmbrs)
+{
+	buffer = new uint8_t[BUFFER];
+
+	memcpy( buffer, MAGIC, 4 );
+	buffer[4] = numbers ? NUMBERS : 0;
+	size = 5;
+}
+
+Offsets::Writer::~Writer()
+{
+	Flush();
+	delete[] buffer;
+}
+
+bool Offsets::Writer::Flush()
+{
+	if( size && !failed )
+	{
+		failed = fwrite( buffer, 1, size, file ) != size;
+	}
+
+	size = 0;
+	return !failed && !fflush(file);
+}
+
+bool Offsets::Reader::Open()
+{
+	char magic[4];
+	const int fl = fread( magic, 1, 4, file ) == 4 && !memcmp( magic, MAGIC, 4 ) ? getc(file) : EOF;
+
+	if( fl == EOF || fl & ~NUMBERS )
+	{
+		failure = ferror(file) ? "cannot read the stream" : "not a stream of the offsets";
+		return false;
+	}
+
+	flags = static_cast< uint8_t >(fl);
+	return true;
+}
+
+bool Offsets::Reader::Get( uint64_t& value, bool first )
+{
+	value = 0;
+	for( int shift = 0; shift < 64; shift += 7 )
+	{
+		const int ch = getc(file);
+		if( ch == EOF )
+		{
+			// the stream may end only between the records
+			failure = ferror(file) ? "cannot read the stream" : first && !shift ? nullptr : "the stream is truncated";
+			return false;
+		}
+
+		value |= uint64_t( ch & 0x7F ) << shift;
+		if( !(ch & 0x80) )
+		{
+			return true;
+		}
+	}
+
+	failure = "the stream is corrupted";
+	return false;
+}
+
+bool Offsets::Reader::Next( Record& record )
+{
+	if( failure )
+	{
+		return false;
+	}
+
+	uint64_t gap;
+	if( !Get( gap, true ) || !Get( record.length ) )
+	{
+		return false;
+	}
+
+	record.number = 0;
+	if( numbers() && !Get( record.number ) )
+	{
+		return false;
+	}
+
+	record.offset = end + gap;
+	record.number += previous;
+
+	end = record.offset + record.length;
+	previous = record.number;
+
+	return true;
+}
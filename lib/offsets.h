@@ -0,0 +1,114 @@
+#ifndef __OFFSETS_HEADER__
+#define __OFFSETS_HEADER__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// A compact binary stream of the positions of the matching lines, for the tools which need where the matches are
+// rather than their text. The stream is a header followed by a record per line, in the input order:
+//   header: the 4 bytes "LRO1" and a byte of the Flags
+//   record: the offset of the line less the end of the previous one, the length of the line without its break
+//           and, with NUMBERS, its number less the number of the previous one
+// every field an unsigned LEB128 varint, so a record takes a few bytes however large the input is.
+struct Offsets
+{
+	static constexpr char MAGIC[] = "LRO1";
+
+	enum Flags : uint8_t
+	{
+		NUMBERS = 1 << 0, // the records have the line numbers
+	};
+
+	struct Record
+	{
+		uint64_t offset, length;
+		uint64_t number; // 0 without NUMBERS
+	};
+
+	class Writer;
+	class Reader;
+};
+
+// encodes the records into a buffer written out when full
+class Offsets::Writer
+{
+public:
+	static constexpr size_t BUFFER = 64 * 1024;
+
+	Writer( FILE*, bool numbers );
+	~Writer(); // flushes
+
+	Writer( const Writer& ) = delete;
+	Writer& operator=( const Writer& ) = delete;
+
+	// the records are to follow the input order
+	void Write( uint64_t offset, uint64_t length, uint64_t number = 0 )
+	{
+		if( size > BUFFER - 3 * MAX )
+		{
+			Flush();
+		}
+
+		Put( offset - end );
+		Put(length);
+
+		if(numbers)
+		{
+			Put( number - previous );
+			previous = number;
+		}
+
+		end = offset + length;
+	}
+
+	bool Flush(); // returns false on an error writing the file, which is sticky
+
+private:
+	static constexpr size_t MAX = 10; // bytes of a 64-bit varint
+
+	void Put( uint64_t value )
+	{
+		for( ; value >= 0x80; value >>= 7 )
+		{
+			buffer[ size++ ] = static_cast< uint8_t >( value | 0x80 );
+		}
+
+		buffer[ size++ ] = static_cast< uint8_t >(value);
+	}
+
+	FILE* const file;
+	const bool numbers;
+
+	uint8_t* buffer;
+	size_t size = 0;
+
+	uint64_t end = 0, previous = 0; // of the previous record
+	bool failed = false;
+};
+
+// decodes the records from a file read through its stdio buffer
+class Offsets::Reader
+{
+public:
+	explicit Reader( FILE* fl ) : file(fl) {}
+
+	bool Open(); // reads the header, returns false if it is not of a stream
+
+	// returns false at the end of the stream or on an error
+	bool Next( Record& );
+
+	bool numbers() const { return flags & NUMBERS; }
+	const char* error() const { return failure; } // nullptr if no error, or at the end of the stream
+
+private:
+	bool Get( uint64_t& value, bool first = false );
+
+	FILE* const file;
+	uint8_t flags = 0;
+
+	uint64_t end = 0, previous = 0; // of the previous record
+	const char* failure = nullptr;
+};
+
+#endif // !__OFFSETS_HEADER__
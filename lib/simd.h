@@ -0,0 +1,183 @@
+#ifndef __SIMD_HEADER__
+#define __SIMD_HEADER__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Vectorized search kernels with SSE2 and NEON implementations and a scalar fallback.
+// A 'fold' byte is OR-ed to every text byte before comparing: 0x20 folds an ASCII letter to lower case
+// when compared to a lower case letter, and 0 means an exact comparison.
+
+#if defined(__ARM_NEON)
+// 4 bits per byte of a comparison result, see Find
+inline uint64_t Nibbles( uint8x16_t eq )
+{
+	return vget_lane_u64( vreinterpret_u64_u8( vshrn_n_u16( vreinterpretq_u16_u8(eq), 4 ) ), 0 );
+}
+#endif
+
+// returns the first position in [from, to) where (byte | fold) == value, or nullptr if not found
+inline const char* Find( const char* from, const char* to, char value, char fold )
+{
+#if defined(__SSE2__)
+	const __m128i v = _mm_set1_epi8(value);
+	const __m128i f = _mm_set1_epi8(fold);
+
+	for( ; to - from >= 16; from += 16 )
+	{
+		const __m128i x = _mm_or_si128( _mm_loadu_si128( reinterpret_cast< const __m128i* >(from) ), f );
+		if( const int mask = _mm_movemask_epi8( _mm_cmpeq_epi8( x, v ) ) )
+		{
+			return from + __builtin_ctz(mask);
+		}
+	}
+#elif defined(__ARM_NEON)
+	const uint8x16_t v = vdupq_n_u8(value);
+	const uint8x16_t f = vdupq_n_u8(fold);
+
+	for( ; to - from >= 16; from += 16 )
+	{
+		const uint8x16_t x = vorrq_u8( vld1q_u8( reinterpret_cast< const uint8_t* >(from) ), f );
+		if( const uint64_t mask = Nibbles( vceqq_u8( x, v ) ) )
+		{
+			return from + (__builtin_ctzll(mask) >> 2);
+		}
+	}
+#endif
+
+	for( ; from != to; ++from )
+	{
+		if( char( *from | fold ) == value )
+		{
+			return from;
+		}
+	}
+
+	return nullptr;
+}
+
+// returns true if no byte in [from, to) has the high bit set, i.e. the text is ASCII
+inline bool Ascii( const char* from, const char* to )
+{
+#if defined(__SSE2__)
+	for( ; to - from >= 64; from += 64 )
+	{
+		const auto a = _mm_loadu_si128( reinterpret_cast< const __m128i* >(from) );
+		const auto b = _mm_loadu_si128( reinterpret_cast< const __m128i* >( from + 16 ) );
+		const auto c = _mm_loadu_si128( reinterpret_cast< const __m128i* >( from + 32 ) );
+		const auto d = _mm_loadu_si128( reinterpret_cast< const __m128i* >( from + 48 ) );
+
+		if( _mm_movemask_epi8( _mm_or_si128( _mm_or_si128( a, b ), _mm_or_si128( c, d ) ) ) )
+		{
+			return false;
+		}
+	}
+
+	for( ; to - from >= 16; from += 16 )
+	{
+		if( _mm_movemask_epi8( _mm_loadu_si128( reinterpret_cast< const __m128i* >(from) ) ) )
+		{
+			return false;
+		}
+	}
+#elif defined(__ARM_NEON)
+	for( ; to - from >= 16; from += 16 )
+	{
+		const uint8x16_t x = vld1q_u8( reinterpret_cast< const uint8_t* >(from) );
+		if( Nibbles( vtstq_u8( x, vdupq_n_u8(0x80) ) ) )
+		{
+			return false;
+		}
+	}
+#endif
+
+	for( ; from != to; ++from )
+	{
+		if( *from & 0x80 )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// sets the bits of the bytes of the 64 at p equal to chars[i] in masks[i], see Field
+inline void Masks( const char* p, const char* chars, size_t n, uint64_t* masks )
+{
+	for( size_t i = 0; i < n; ++i )
+	{
+		masks[i] = 0;
+	}
+
+#if defined(__SSE2__)
+	for( size_t k = 0; k < 64; k += 16 )
+	{
+		const __m128i x = _mm_loadu_si128( reinterpret_cast< const __m128i* >( p + k ) );
+		for( size_t i = 0; i < n; ++i )
+		{
+			const uint64_t bits = static_cast< uint16_t >( _mm_movemask_epi8( _mm_cmpeq_epi8( x, _mm_set1_epi8( chars[i] ) ) ) );
+			masks[i] |= bits << k;
+		}
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	static const uint8_t WEIGHTS[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+	const uint8x16_t weights = vld1q_u8(WEIGHTS);
+
+	for( size_t k = 0; k < 64; k += 16 )
+	{
+		const uint8x16_t x = vld1q_u8( reinterpret_cast< const uint8_t* >( p + k ) );
+		for( size_t i = 0; i < n; ++i )
+		{
+			// a bit per byte, the halves summed into two bytes
+			uint8x16_t bits = vandq_u8( vceqq_u8( x, vdupq_n_u8( chars[i] ) ), weights );
+			bits = vpaddq_u8( bits, bits );
+			bits = vpaddq_u8( bits, bits );
+			bits = vpaddq_u8( bits, bits );
+
+			masks[i] |= uint64_t( vgetq_lane_u16( vreinterpretq_u16_u8(bits), 0 ) ) << k;
+		}
+	}
+#else
+	for( size_t k = 0; k < 64; ++k )
+	{
+		for( size_t i = 0; i < n; ++i )
+		{
+			masks[i] |= uint64_t( p[k] == chars[i] ) << k;
+		}
+	}
+#endif
+}
+
+// returns the bits of the bytes of the 64 at p equal to the value, see Newlines
+inline uint64_t Bits( const char* p, char value )
+{
+#if defined(__SSE2__)
+	const __m128i v = _mm_set1_epi8(value);
+
+	const auto a = _mm_cmpeq_epi8( _mm_loadu_si128( reinterpret_cast< const __m128i* >(p) ), v );
+	const auto b = _mm_cmpeq_epi8( _mm_loadu_si128( reinterpret_cast< const __m128i* >( p + 16 ) ), v );
+	const auto c = _mm_cmpeq_epi8( _mm_loadu_si128( reinterpret_cast< const __m128i* >( p + 32 ) ), v );
+	const auto d = _mm_cmpeq_epi8( _mm_loadu_si128( reinterpret_cast< const __m128i* >( p + 48 ) ), v );
+
+	uint64_t bits = static_cast< uint16_t >( _mm_movemask_epi8(a) );
+	bits |= uint64_t( static_cast< uint16_t >( _mm_movemask_epi8(b) ) ) << 16;
+	bits |= uint64_t( static_cast< uint16_t >( _mm_movemask_epi8(c) ) ) << 32;
+	bits |= uint64_t( static_cast< uint16_t >( _mm_movemask_epi8(d) ) ) << 48;
+
+	return bits;
+#else
+	uint64_t bits;
+	Masks( p, &value, 1, &bits );
+
+	return bits;
+#endif
+}
+
+#endif // !__SIMD_HEADER__
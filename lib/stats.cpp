@@ -0,0 +1,154 @@
+#include "stats.h"
+
+#include <time.h>
+
+static const char* const NAMES[] = { "read", "dispatch", "tail", "match", "wait", "handle" };
+
+Stats::Stats( bool trc ) : origin( Wall() ), trace(trc)
+{
+}
+
+void Stats::Add( Stage stage, double started, double finished, double cpu, size_t bts )
+{
+	Accumulate( stage, finished - started, cpu );
+	Record( NAMES[stage], 0, started, finished, bts );
+}
+
+void Stats::AddWorker( size_t worker, double started, double finished, double cpu, size_t bts, size_t lns, size_t mtchs )
+{
+	Accumulate( MATCH, finished - started, cpu );
+	Record( NAMES[MATCH], worker + 1, started, finished, bts );
+
+	lines += lns;
+	matches += mtchs;
+
+	if( worker < WORKERS )
+	{
+		auto& stats = workers[worker];
+		++stats.runs;
+		stats.bytes += bts;
+		stats.lines += lns;
+		stats.matches += mtchs;
+		stats.busy += finished - started;
+		stats.idle -= finished - started; // completed by AddBlock
+	}
+}
+
+void Stats::AddBlock( double started, double finished, size_t bts, size_t nworkers )
+{
+	++blocks;
+	bytes += bts;
+
+	for( size_t i = 0; i < nworkers && i < WORKERS; ++i )
+	{
+		workers[i].idle += finished - started;
+	}
+
+	Record( "block", 0, started, finished, bts );
+}
+
+void Stats::Print( FILE* file ) const
+{
+	const double elapsed = Wall() - origin;
+
+	fprintf( file, "%-10s %12s %12s %10s\n", "stage", "wall ms", "cpu ms", "calls" );
+	for( size_t i = 0; i < STAGES; ++i )
+	{
+		fprintf( file, "%-10s %12.3f %12.3f %10zu\n", NAMES[i], stages[i].wall * 1e3, stages[i].cpu * 1e3, stages[i].count );
+	}
+
+	fprintf( file, "\nelapsed %.3f ms, %zu blocks, %zu bytes, %zu lines, %zu matches, %zu bytes carried over\n",
+		elapsed * 1e3, blocks, bytes, lines, matches, carried );
+
+	if( elapsed > 0 )
+	{
+		fprintf( file, "throughput %.3f GB/s, %.3f M lines/s\n", bytes / elapsed / 1e9, lines / elapsed / 1e6 );
+	}
+
+	fprintf( file, "\n%-10s %8s %14s %12s %10s %12s %12s %8s\n", "worker", "runs", "bytes", "lines", "matches", "busy ms", "idle ms", "busy %" );
+	for( size_t i = 0; i < WORKERS; ++i )
+	{
+		const auto& worker = workers[i];
+		if( !worker.runs )
+		{
+			continue;
+		}
+
+		const auto total = worker.busy + worker.idle;
+		fprintf( file, "%-10zu %8zu %14zu %12zu %10zu %12.3f %12.3f %7.1f%%\n", i, worker.runs, worker.bytes, worker.lines, worker.matches,
+			worker.busy * 1e3, worker.idle * 1e3, total > 0 ? worker.busy / total * 100 : 0.0 );
+	}
+
+	if(dropped)
+	{
+		fprintf( file, "\n%zu trace events dropped\n", dropped );
+	}
+}
+
+bool Stats::WriteTrace( FILE* file ) const
+{
+	if( !trace )
+	{
+		return false;
+	}
+
+	fputs( "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file );
+	fputs( "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"reader\"}}", file );
+
+	for( size_t i = 0; i < WORKERS; ++i )
+	{
+		if( workers[i].runs )
+		{
+			fprintf( file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"worker %zu\"}}", i+1, i );
+		}
+	}
+
+	for( const auto& event : events.data() )
+	{
+		fprintf( file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"bytes\":%zu}}",
+			event.name, event.thread, event.started * 1e6, event.duration * 1e6, event.bytes );
+	}
+
+	fputs( "\n]}\n", file );
+	return true;
+}
+
+double Stats::Wall()
+{
+	timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+double Stats::Cpu()
+{
+	timespec ts;
+	clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts );
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void Stats::Accumulate( Stage stage, double wall, double cpu )
+{
+	auto& time = stages[stage];
+	time.wall += wall;
+	time.cpu += cpu;
+	++time.count;
+}
+
+void Stats::Record( const char* name, size_t thread, double started, double finished, size_t bts )
+{
+	if( !trace )
+	{
+		return;
+	}
+
+	if( events.size() == EVENTS )
+	{
+		++dropped;
+		return;
+	}
+
+	events.Append( { name, thread, started - origin, finished - started, bts } );
+}
@@ -0,0 +1,122 @@
+#ifndef __STATS_HEADER__
+#define __STATS_HEADER__
+
+#include "basic.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Performance statistics of a reader: wall and CPU time per stage, the volume of the input,
+// per-worker busy and idle time and optionally a trace of per-block spans in the Chrome trace format
+// (chrome://tracing, ui.perfetto.dev). Collected only when passed to the reader, so the reader
+// only checks a pointer when disabled.
+// Not thread-safe: all the records are made on the thread calling the reader.
+class Stats
+{
+public:
+	static constexpr size_t WORKERS = 64; // maximum number of the workers recorded
+	static constexpr size_t EVENTS = 1 << 20; // maximum number of the trace events kept
+
+	enum Stage
+	{
+		READ, // getting the input, recorded by the caller
+		DISPATCH, // splitting a block among the workers and starting them
+		TAIL, // serial processing of the line carried over from the previous block
+		MATCH, // matching by the workers, the sum over all of them
+		WAIT, // waiting for the workers to finish
+		HANDLE, // passing the results to the handler
+		STAGES
+	};
+
+	struct Time
+	{
+		double wall = 0, cpu = 0; // seconds
+		size_t count = 0;
+	};
+
+	struct Worker
+	{
+		size_t runs = 0;
+		size_t bytes = 0, lines = 0, matches = 0;
+
+		double busy = 0; // seconds spent processing
+		double idle = 0; // seconds of the blocks the worker took part in, but was not busy
+	};
+
+	// measures a stage on the calling thread from construction to destruction, does nothing without stats
+	class Span;
+
+	explicit Stats( bool trace = false );
+
+	Stats( const Stats& ) = delete;
+	Stats& operator=( const Stats& ) = delete;
+
+	void Add( Stage, double started, double finished, double cpu, size_t bytes = 0 );
+	void AddWorker( size_t worker, double started, double finished, double cpu, size_t bytes, size_t lines, size_t matches );
+	void AddBlock( double started, double finished, size_t bytes, size_t workers );
+
+	void Print( FILE* ) const;
+	bool WriteTrace( FILE* ) const; // returns false if no trace was recorded
+
+	static double Wall(); // monotonic time in seconds
+	static double Cpu(); // CPU time of the calling thread in seconds
+
+	Time stages[STAGES];
+	Worker workers[WORKERS];
+
+	size_t blocks = 0;
+	size_t bytes = 0, lines = 0, matches = 0; // scanned
+	size_t carried = 0; // bytes of the incomplete lines carried over to the next block
+
+private:
+	struct Event
+	{
+		const char* name;
+		size_t thread; // 0 for the calling one, 1 + index of a worker
+		double started, duration;
+		size_t bytes;
+	};
+
+	void Accumulate( Stage, double wall, double cpu );
+	void Record( const char* name, size_t thread, double started, double finished, size_t bytes );
+
+	const double origin; // the time of creation
+	const bool trace;
+
+	Buffer<Event> events;
+	size_t dropped = 0; // events over the limit
+};
+
+class Stats::Span
+{
+public:
+	Span( Stats* sts, Stage stg, size_t bts = 0 ) : bytes(bts), stats(sts), stage(stg)
+	{
+		if(stats)
+		{
+			started = Wall();
+			cpu = Cpu();
+		}
+	}
+
+	~Span()
+	{
+		if(stats)
+		{
+			stats->Add( stage, started, Wall(), Cpu() - cpu, bytes );
+		}
+	}
+
+	Span( const Span& ) = delete;
+	Span& operator=( const Span& ) = delete;
+
+	size_t bytes; // may be set before the end of the span
+
+private:
+	Stats* const stats;
+	const Stage stage;
+
+	double started = 0, cpu = 0;
+};
+
+#endif // !__STATS_HEADER__
@@ -0,0 +1,234 @@
+#include "tuner.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// the number of the CPUs the process may run on
+static size_t Cpus()
+{
+#ifdef __linux__
+	cpu_set_t allowed;
+	if( !sched_getaffinity( 0, sizeof(allowed), &allowed ) )
+	{
+		return CPU_COUNT(&allowed);
+	}
+#endif
+
+	const auto cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return cpus > 0 ? size_t(cpus) : 1;
+}
+
+Tuner::Tuner( size_t workers, size_t grain ) : grn(grain)
+{
+	const auto cpus = Cpus();
+
+	maximum = workers ? workers : 1;
+	maximum = cpus && cpus < maximum ? cpus : maximum;
+	current = maximum;
+
+	// nothing to choose from
+	done = maximum == 1;
+}
+
+size_t Tuner::Split( size_t bytes ) const
+{
+	const auto n = bytes <= grn ? 1 : bytes / grn;
+	return n <= current ? n : current;
+}
+
+void Tuner::Record( size_t bytes, size_t n, double elapsed, double delay, double busy )
+{
+	if( done || !bytes || elapsed <= 0 )
+	{
+		return;
+	}
+
+	if(warmup)
+	{
+		--warmup;
+		return;
+	}
+
+	// the grain making the start of a worker a small share of its work
+	if( busy > 0 )
+	{
+		delays += delay;
+		speeds += bytes / n / busy;
+		++samples;
+
+		auto grain = static_cast< size_t >( delays / samples * (speeds / samples) / OVERHEAD );
+		grain = grain < MINIMUM ? MINIMUM : grain > MAXIMUM ? MAXIMUM : grain;
+		grn = (grain + 4095) / 4096 * 4096;
+	}
+
+	costs[candidate] += elapsed / bytes;
+	if( ++probes < PROBES )
+	{
+		return;
+	}
+
+	probes = 0;
+	if( current == 1 || candidate + 1 == CANDIDATES )
+	{
+		Settle();
+		return;
+	}
+
+	++candidate;
+	current = maximum >> candidate;
+}
+
+void Tuner::Settle()
+{
+	// from the fewest workers, more are taken only if they are noticeably faster
+	size_t best = candidate;
+	for( auto i = candidate; i--; )
+	{
+		if( costs[i] < costs[best] * 0.95 )
+		{
+			best = i;
+		}
+	}
+
+	current = maximum >> best;
+	done = true;
+}
+
+bool Tuner::Host( char* name, size_t size ) const
+{
+	if( gethostname( name, size ) )
+	{
+		return false;
+	}
+
+	name[ size-1 ] = 0;
+	for( auto p = name; *p; ++p )
+	{
+		if( *p == ' ' || *p == '\t' || *p == '\n' )
+		{
+			*p = '_';
+		}
+	}
+
+	return *name;
+}
+
+bool Tuner::Load( const char* path )
+{
+	char host[256];
+	FILE* file = fopen( path, "r" );
+
+	if( !file || !Host( host, sizeof(host) ) )
+	{
+		if(file)
+		{
+			fclose(file);
+		}
+
+		return false;
+	}
+
+	char line[512], name[256];
+	size_t workers, grain;
+
+	bool found = false;
+	while( !found && fgets( line, sizeof(line), file ) )
+	{
+		found = sscanf( line, "%255s %zu %zu", name, &workers, &grain ) == 3 && !strcmp( name, host ) && workers;
+	}
+
+	fclose(file);
+
+	if( !found )
+	{
+		return false;
+	}
+
+	current = workers < maximum ? workers : maximum;
+	grn = grain < MINIMUM ? MINIMUM : grain > MAXIMUM ? MAXIMUM : grain;
+	done = loaded = true;
+
+	return true;
+}
+
+bool Tuner::Save( const char* path ) const
+{
+	if( loaded )
+	{
+		return true; // as it is
+	}
+
+	char host[256];
+	if( !done || !Host( host, sizeof(host) ) )
+	{
+		return false;
+	}
+
+	// the lines of the other hosts are kept, the file is replaced at once
+	char temporary[4096];
+	if( snprintf( temporary, sizeof(temporary), "%s.%d", path, int( getpid() ) ) >= int( sizeof(temporary) ) )
+	{
+		return false;
+	}
+
+	FILE* output = fopen( temporary, "w" );
+	if( !output )
+	{
+		return false;
+	}
+
+	if( FILE* input = fopen( path, "r" ) )
+	{
+		char line[512], name[256];
+		while( fgets( line, sizeof(line), input ) )
+		{
+			if( sscanf( line, "%255s", name ) != 1 || strcmp( name, host ) )
+			{
+				fputs( line, output );
+			}
+		}
+
+		fclose(input);
+	}
+
+	fprintf( output, "%s %zu %zu\n", host, current, grn );
+
+	if( fclose(output) || rename( temporary, path ) )
+	{
+		unlink(temporary);
+		return false;
+	}
+
+	return true;
+}
+
+void Tuner::Print( FILE* file ) const
+{
+	fprintf( file, "\ntuned %zu workers of %zu, grain %zu bytes", current, maximum, grn );
+
+	if(loaded)
+	{
+		fputs( ", from the profile\n", file );
+	}
+	else if( maximum == 1 )
+	{
+		fputs( ", a single CPU\n", file );
+	}
+	else if(done)
+	{
+		fputs( ", probed\n", file );
+		for( size_t i = 0; i <= candidate; ++i )
+		{
+			fprintf( file, "  up to %zu workers: %.3f GB/s\n", maximum >> i, costs[i] > 0 ? PROBES / costs[i] / 1e9 : 0.0 );
+		}
+	}
+	else
+	{
+		fputs( ", still probing\n", file );
+	}
+}
@@ -0,0 +1,65 @@
+#ifndef __TUNER_HEADER__
+#define __TUNER_HEADER__
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Chooses the number of the workers and the minimal slice of a block per worker (the grain) from the measurements
+// of the first blocks of a run, instead of the fixed split of a block by its size.
+// Every maximum number of the workers from the most down to 1, halving, is tried for a few blocks, and the one
+// processing a byte in the least wall time is kept. The grain is set so the delay of starting
+// a worker, measured from its start to the beginning of its work, is a small share of the work on its slice.
+// The choice can be saved to a profile of the hosts and loaded on the next runs instead of probing again.
+// Not thread-safe: used on the thread calling the reader.
+class Tuner
+{
+public:
+	static constexpr size_t PROBES = 2; // blocks measured per number of the workers
+	static constexpr size_t MINIMUM = 64 * 1024, MAXIMUM = 16 * 1024 * 1024; // bounds of the grain
+	static constexpr double OVERHEAD = 0.1; // tolerated share of the start of a worker in its work
+
+	// the maximum number of the workers of the reader, limited to the CPUs available, and the initial grain
+	Tuner( size_t workers, size_t grain );
+
+	size_t Split( size_t bytes ) const; // the number of the workers for a block of the size
+
+	// a block of the size processed by n workers in the wall time from starting the first of them to joining the last,
+	// the delay and busy time are the means of the workers
+	void Record( size_t bytes, size_t n, double elapsed, double delay, double busy );
+
+	bool settled() const { return done; } // the measurements are no longer needed
+	size_t workers() const { return current; }
+	size_t grain() const { return grn; }
+
+	// the line of the host in the profile, a line per host: '<host> <workers> <grain>'
+	bool Load( const char* path ); // returns false if there is none
+	bool Save( const char* path ) const; // adds or replaces the line of the host, after settling unless loaded
+
+	void Print( FILE* ) const; // the chosen parameters and how, for the stats
+
+private:
+	static constexpr size_t CANDIDATES = 8;
+
+	bool Host( char* name, size_t size ) const; // the key of the host in the profile
+
+	void Settle();
+
+	size_t maximum; // workers
+
+	size_t current; // maximum workers per block, the candidate being probed until settled
+	size_t grn;
+
+	bool done = false;
+	bool loaded = false;
+
+	size_t candidate = 0; // index of the one being probed
+	size_t probes = 0; // blocks measured of it
+	double costs[CANDIDATES] = {}; // seconds per byte, summed over the probes
+
+	size_t warmup = 1; // the first blocks are not measured, the input and the code are cold
+
+	double delays = 0, speeds = 0; // summed over the measured blocks
+	size_t samples = 0;
+};
+
+#endif // !__TUNER_HEADER__